@@ -0,0 +1,716 @@
+#include "ExpressionEvaluator.hpp"
+#include "ExpressionServer.hpp"
+#include "CompiledExpression.hpp"
+#include "ExpressionFilter.hpp"
+#include "ExpressionPipeline.hpp"
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <cstring>
+#include <cstdlib>
+#include <atomic>
+#include <new>
+#include <mutex>
+#include <random>
+#include <functional>
+#include <cmath>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/**
+ * Benchmark driver
+ * Measures the parsers and evaluators on generated workloads
+ */
+
+// Count heap allocations so the one-shot benchmark can verify the zero-allocation path
+static std::atomic<size_t> allocationCount{0};
+
+void* operator new(size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    if (void* pointer = std::malloc(size ? size : 1)) return pointer;
+    throw std::bad_alloc();
+}
+
+// Out of line, so the compiler does not pair inlined new/delete calls with malloc/free
+__attribute__((noinline)) void operator delete(void* pointer) noexcept { std::free(pointer); }
+__attribute__((noinline)) void operator delete(void* pointer, size_t) noexcept { std::free(pointer); }
+
+// Generate a balanced, fully parenthesized sum of products with 2^depth leaves
+static void appendBalanced(std::string& expression, int depth, size_t& leaf) {
+    if (depth == 0) {
+        expression += std::to_string(leaf % 97) + " * " + std::to_string(leaf % 7);
+        ++leaf;
+        return;
+    }
+    expression += "(";
+    appendBalanced(expression, depth - 1, leaf);
+    expression += (depth % 2 == 0) ? " + " : " - ";
+    appendBalanced(expression, depth - 1, leaf);
+    expression += ")";
+}
+
+// Generate a machine-style expression of roughly the requested length: a
+// top-level sum of balanced groups, so the tree stays shallow enough for the
+// recursive evaluator while offering many independent top-level operands
+static std::string generateExpression(size_t targetLength) {
+    const size_t groupLength = 64 * 1024;
+    int depth = 0;
+    while ((size_t(1) << depth) * 12 < groupLength) ++depth;
+    
+    std::string expression;
+    expression.reserve(targetLength + 2 * groupLength);
+    size_t leaf = 0;
+    for (size_t group = 0; expression.length() < targetLength; ++group) {
+        if (group > 0) expression += " + ";
+        appendBalanced(expression, depth, leaf);
+    }
+    return expression;
+}
+
+// Time a callable and return elapsed milliseconds
+template <typename Function>
+static double timeMilliseconds(Function function) {
+    auto start = std::chrono::steady_clock::now();
+    function();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+// Compare the serial parser against the parallel parser for several thread
+// counts. After a warm-up, the serial and parallel runs alternate for a few
+// rounds and the fastest time of each is reported, so neither side pays for
+// cold caches or first-touch page faults.
+static void benchmarkParallelParse(size_t length) {
+    const int rounds = 3;
+    ExpressionEvaluator evaluator;
+    std::string expression = generateExpression(length);
+    
+    std::vector<size_t> threadCounts;
+    size_t maxThreads = std::max(2u, std::thread::hardware_concurrency());
+    for (size_t threads = 1; threads <= maxThreads; threads *= 2) {
+        threadCounts.push_back(threads);
+    }
+    
+    double serialResult = evaluator.evaluate(evaluator.buildExpressionTree(expression));
+    double serialTime = 1e300;
+    std::vector<double> parallelTimes(threadCounts.size(), 1e300);
+    std::vector<bool> mismatch(threadCounts.size(), false);
+    for (int round = 0; round < rounds; ++round) {
+        serialTime = std::min(serialTime, timeMilliseconds([&]() {
+            evaluator.evaluate(evaluator.buildExpressionTree(expression));
+        }));
+        for (size_t i = 0; i < threadCounts.size(); ++i) {
+            double parallelResult = 0;
+            parallelTimes[i] = std::min(parallelTimes[i], timeMilliseconds([&]() {
+                parallelResult = evaluator.evaluate(evaluator.buildExpressionTreeParallel(expression, threadCounts[i]));
+            }));
+            mismatch[i] = mismatch[i] || parallelResult != serialResult;
+        }
+    }
+    
+    std::cout << "Parallel parse scaling (" << expression.length() << " chars, best of " << rounds << ")" << std::endl;
+    std::cout << "  serial:      " << std::fixed << std::setprecision(1) << serialTime << " ms" << std::endl;
+    for (size_t i = 0; i < threadCounts.size(); ++i) {
+        std::cout << "  " << std::setw(2) << threadCounts[i] << " threads:  " << parallelTimes[i] << " ms"
+                  << "  speedup " << std::setprecision(2) << serialTime / parallelTimes[i]
+                  << (mismatch[i] ? "  RESULT MISMATCH" : "")
+                  << std::setprecision(1) << std::endl;
+    }
+}
+
+// inf and nan, which strtod accepts but which are not plain digits, must
+// parse as double literals, never as integer nodes. Exponents such as 1e3
+// must be rejected by the lexer: integer typing only looks for '.', 'e' and
+// 'E', so if the lexer starts accepting other forms this check fails until
+// their typing is checked here too. Returns false and reports any mismatch.
+static bool checkLiteralTypes(const ExpressionEvaluator& evaluator) {
+    bool passed = true;
+    const std::vector<std::string> literals = {"inf", "nan"};
+    for (const std::string& literal : literals) {
+        std::vector<std::string> expressions = {literal, literal + " + 1"};
+        for (const std::string& expression : expressions) {
+            ExpressionEvaluator::Value value{false, 0, 0};
+            ExpressionTree built;
+            ExpressionError::Code error = evaluator.tryBuildExpressionTree(expression, built);
+            if (error == ExpressionError::NONE) {
+                error = evaluator.tryEvaluate(built, value);
+            }
+            double expected = std::strtod(literal.c_str(), nullptr) + (expression == literal ? 0 : 1);
+            bool same = value.toDouble() == expected || (std::isnan(expected) && std::isnan(value.toDouble()));
+            if (error != ExpressionError::NONE || value.isInteger || !same) {
+                std::cout << "  LITERAL MISTYPED: " << expression << " = "
+                          << (error != ExpressionError::NONE ? ExpressionError::message(error)
+                                                             : ExpressionEvaluator::formatResult(value))
+                          << std::endl;
+                passed = false;
+            }
+        }
+    }
+    
+    const std::vector<std::string> exponents = {"1e3", "1e3 + 1", "2E-2"};
+    for (const std::string& expression : exponents) {
+        ExpressionTree built;
+        if (evaluator.tryBuildExpressionTree(expression, built) == ExpressionError::NONE) {
+            std::cout << "  EXPONENT LITERAL ACCEPTED: " << expression << std::endl;
+            passed = false;
+        }
+    }
+    return passed;
+}
+
+// Check that evaluateBatch over strings reports each row like tryEvaluate
+// does: parse errors keep their own code rather than a later NULL_NODE
+static bool checkBatchErrors(const ExpressionEvaluator& evaluator) {
+    const std::vector<std::string> expressions = {
+        "(1+2", "3+", "1 / 0", "2 * (x - 1)", "1 +* 2", "7 % 3", "unknown + 1"
+    };
+    ExpressionEvaluator::BatchResult batch = evaluator.evaluateBatch(expressions);
+    bool passed = true;
+    for (size_t row = 0; row < expressions.size(); ++row) {
+        ExpressionEvaluator::Value value;
+        ExpressionError::Code expected = evaluator.tryEvaluate(expressions[row], value);
+        bool sameValue = expected != ExpressionError::NONE
+            ? std::isnan(batch.values[row]) : batch.values[row] == value.toDouble();
+        if (batch.errors[row] != expected || batch.hasError(row) != (expected != ExpressionError::NONE) ||
+            !sameValue) {
+            std::cout << "  BATCH ERROR MISMATCH: " << expressions[row] << " reported "
+                      << ExpressionError::message(batch.errors[row]) << std::endl;
+            passed = false;
+        }
+    }
+    return passed;
+}
+
+// Evaluate short expressions one at a time, through the direct (allocation
+// free) path and through an explicit tree, and check the allocation count.
+// Returns nonzero if the direct path allocated, a literal is mistyped or a
+// batch row reports the wrong error.
+static int benchmarkOneShot(size_t iterations) {
+    const std::vector<std::string> expressions = {
+        "1 + 2 * 3",
+        "(x + 1.5) * (y - 2) / 4",
+        "-(3 ^ 4) % 7 + ~5",
+        "x > 2 && y <= 10 or not (x == y)",
+        "(1 << 20) | 255 + 12345678901 * 3",
+        "((((x * 2) + 3) * 4) - 5) / (y + 0.25)"
+    };
+    ExpressionEvaluator evaluator;
+    evaluator.setVariable("x", 3.25);
+    evaluator.setVariable("y", 7);
+    bool literalsTyped = checkLiteralTypes(evaluator);
+    bool batchErrors = checkBatchErrors(evaluator);
+    
+    // Warm up: static tables and the first error path are initialised here
+    ExpressionEvaluator::Value value;
+    for (const std::string& expression : expressions) {
+        evaluator.tryEvaluate(expression, value);
+    }
+    
+    double directSum = 0;
+    size_t before = allocationCount.load();
+    double directTime = timeMilliseconds([&]() {
+        for (size_t i = 0; i < iterations; ++i) {
+            for (const std::string& expression : expressions) {
+                evaluator.tryEvaluate(expression, value);
+                directSum += value.toDouble();
+            }
+        }
+    });
+    size_t directAllocations = allocationCount.load() - before;
+    
+    double treeSum = 0;
+    before = allocationCount.load();
+    double treeTime = timeMilliseconds([&]() {
+        for (size_t i = 0; i < iterations; ++i) {
+            for (const std::string& expression : expressions) {
+                ExpressionTree tree;
+                evaluator.tryBuildExpressionTree(expression, tree);
+                evaluator.tryEvaluate(tree, value);
+                treeSum += value.toDouble();
+            }
+        }
+    });
+    size_t treeAllocations = allocationCount.load() - before;
+    
+    size_t evaluations = iterations * expressions.size();
+    std::cout << "One-shot evaluation (" << evaluations << " evaluations)" << std::endl;
+    std::cout << std::fixed << std::setprecision(1)
+              << "  direct: " << directTime << " ms, " << 1e6 * directTime / evaluations << " ns/expr, "
+              << directAllocations << " allocations" << std::endl
+              << "  tree:   " << treeTime << " ms, " << 1e6 * treeTime / evaluations << " ns/expr, "
+              << treeAllocations << " allocations" << std::endl;
+    if (directSum != treeSum) {
+        std::cout << "  RESULT MISMATCH" << std::endl;
+        return 1;
+    }
+    return (directAllocations == 0 && literalsTyped && batchErrors) ? 0 : 1;
+}
+
+// Evaluate shared compiled expressions from 1, 2, 4, ... threads. Every
+// thread runs the same workload, so per-thread checksums must agree and
+// throughput should grow linearly up to the number of cores. A single
+// evaluator behind a mutex is measured for comparison.
+static int benchmarkConcurrent(size_t evaluationsPerThread) {
+    const std::vector<std::string> expressions = {
+        "x * x + 2 * x * y + y * y",
+        "(x * 1.5 + y) / (x - y + 10) > 0.5 && x % 7 < 3",
+        "((x << 3) xor (y & 255)) - (x >> 1)",
+        "-(x ^ 2) + y * (3 - x) / 4"
+    };
+    ExpressionEvaluator evaluator;
+    std::vector<CompiledExpression> compiled;
+    std::vector<ExpressionTree> trees;
+    for (const std::string& expression : expressions) {
+        compiled.emplace_back(evaluator, expression);
+        trees.push_back(evaluator.buildExpressionTree(expression));
+    }
+    
+    // The workload of one thread: every expression over a sweep of inputs
+    auto compiledWorkload = [&]() {
+        double checksum = 0;
+        for (size_t i = 0; i < evaluationsPerThread; ++i) {
+            double variables[2] = {static_cast<double>(i % 1000), static_cast<double>(i % 37)};
+            const CompiledExpression& expression = compiled[i % compiled.size()];
+            ExpressionEvaluator::Value value;
+            if (expression.evaluate(variables, value) == ExpressionError::NONE) checksum += value.toDouble();
+        }
+        return checksum;
+    };
+    std::mutex evaluatorMutex;
+    auto lockedWorkload = [&]() {
+        double checksum = 0;
+        for (size_t i = 0; i < evaluationsPerThread; ++i) {
+            std::lock_guard<std::mutex> lock(evaluatorMutex);
+            evaluator.setVariable("x", static_cast<double>(i % 1000));
+            evaluator.setVariable("y", static_cast<double>(i % 37));
+            ExpressionEvaluator::Value value;
+            if (evaluator.tryEvaluate(trees[i % trees.size()], value) == ExpressionError::NONE) {
+                checksum += value.toDouble();
+            }
+        }
+        return checksum;
+    };
+    
+    // Run workload on threads threads; returns evaluations per second
+    bool consistent = true;
+    auto run = [&](size_t threads, auto workload) {
+        std::vector<double> checksums(threads);
+        double milliseconds = timeMilliseconds([&]() {
+            std::vector<std::thread> workers;
+            for (size_t t = 0; t < threads; ++t) {
+                workers.emplace_back([&, t]() { checksums[t] = workload(); });
+            }
+            for (auto& worker : workers) worker.join();
+        });
+        for (double checksum : checksums) {
+            consistent = consistent && checksum == checksums[0];
+        }
+        return 1000.0 * threads * evaluationsPerThread / milliseconds;
+    };
+    
+    std::cout << "Concurrent evaluation (" << evaluationsPerThread << " evaluations per thread, "
+              << std::thread::hardware_concurrency() << " cores)" << std::endl;
+    std::cout << std::fixed << std::setprecision(2);
+    size_t maxThreads = std::max(2u, 2 * std::thread::hardware_concurrency());
+    double compiledBase = 0, lockedBase = 0;
+    for (size_t threads = 1; threads <= maxThreads; threads *= 2) {
+        double compiledRate = run(threads, compiledWorkload);
+        double lockedRate = run(threads, lockedWorkload);
+        if (threads == 1) {
+            compiledBase = compiledRate;
+            lockedBase = lockedRate;
+        }
+        std::cout << "  " << std::setw(2) << threads << " threads:  compiled " << compiledRate / 1e6
+                  << " M/s (x" << compiledRate / compiledBase << ")   mutex " << lockedRate / 1e6
+                  << " M/s (x" << lockedRate / lockedBase << ")" << std::endl;
+    }
+    if (!consistent) {
+        std::cout << "  CHECKSUM MISMATCH" << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// Filter columnar rows with a conjunctive predicate: row-at-a-time
+// evaluation scanned for nonzero results against the bitmap and selection
+// vector of ExpressionFilter. All three must find the same rows. Then show
+// the filter reordering a badly written conjunction.
+static int benchmarkFilter(size_t rowCount) {
+    const std::vector<std::string> predicates = {
+        "x >= 0.2 && y < 0.5 && z != 0.75 && x < y",
+        "x < 0.01 && y > 0.5",
+        "(x > 0.9 || y > 0.9) and not (z <= 0.5)",
+        "x * y > 0.25 && z < 0.5"
+    };
+    ExpressionEvaluator evaluator;
+    std::mt19937_64 random(7);
+    std::uniform_real_distribution<double> uniform(0, 1);
+    std::vector<std::vector<double>> data(3, std::vector<double>(rowCount));
+    for (auto& column : data) {
+        for (double& value : column) value = uniform(random);
+    }
+    
+    std::cout << "Filter (" << rowCount << " rows)" << std::endl;
+    std::cout << std::fixed << std::setprecision(2);
+    bool consistent = true;
+    for (const std::string& predicate : predicates) {
+        ExpressionFilter filter(evaluator, predicate);
+        CompiledExpression compiled(evaluator, predicate);
+        std::vector<const double*> columns;
+        for (const std::string& name : filter.getVariables()) {
+            columns.push_back(data[name[0] - 'x'].data());
+        }
+        
+        size_t rowMatches = 0, bitmapMatches = 0, selectMatches = 0;
+        std::vector<double> values(columns.size());
+        double rowTime = timeMilliseconds([&]() {
+            for (size_t row = 0; row < rowCount; ++row) {
+                for (size_t i = 0; i < columns.size(); ++i) values[i] = columns[i][row];
+                ExpressionEvaluator::Value value;
+                if (compiled.evaluate(values.data(), value) == ExpressionError::NONE && value.toDouble() != 0) {
+                    ++rowMatches;
+                }
+            }
+        });
+        std::vector<uint64_t> bitmap;
+        double bitmapTime = timeMilliseconds([&]() {
+            bitmapMatches = filter.filter(columns.data(), rowCount, bitmap);
+        });
+        std::vector<size_t> selection;
+        double selectTime = timeMilliseconds([&]() {
+            selectMatches = filter.select(columns.data(), rowCount, selection);
+        });
+        
+        consistent = consistent && rowMatches == bitmapMatches && rowMatches == selectMatches;
+        std::cout << "  " << predicate << "  (" << 100.0 * rowMatches / rowCount << "% match)" << std::endl
+                  << "    per row: " << 1e6 * rowTime / rowCount << " ns/row   bitmap: "
+                  << 1e6 * bitmapTime / rowCount << " ns/row   selection: "
+                  << 1e6 * selectTime / rowCount << " ns/row" << std::endl;
+    }
+    
+    // An expensive, unselective operand written first: sampling should move
+    // the cheap selective comparison to the front after a few passes
+    ExpressionFilter adaptive(evaluator, "(x * y + y * z) * (x + z) > 0.01 && z < 0.01");
+    const double* columns[3] = {data[0].data(), data[1].data(), data[2].data()};
+    std::vector<uint64_t> bitmap;
+    size_t firstMatches = 0;
+    std::cout << "  adaptive order:" << std::endl;
+    for (int pass = 0; pass < 4; ++pass) {
+        size_t matches = 0;
+        double milliseconds = timeMilliseconds([&]() { matches = adaptive.filter(columns, rowCount, bitmap); });
+        if (pass == 0) firstMatches = matches;
+        consistent = consistent && matches == firstMatches;
+        std::cout << "    pass " << pass << ": " << 1e6 * milliseconds / rowCount << " ns/row" << std::endl;
+    }
+    ExpressionFilter::Stats stats = adaptive.getStats();
+    for (const ExpressionFilter::ChainStats& chain : stats.chains) {
+        for (const ExpressionFilter::OperandStats& operand : chain.operands) {
+            std::cout << "    " << chain.op << " " << operand.expression << "  pass rate " << operand.passRate
+                      << ", " << operand.nanosecondsPerRow << " ns/row" << std::endl;
+        }
+    }
+    std::cout << "    reorders: " << stats.reorders << std::endl;
+    
+    if (!consistent) {
+        std::cout << "  MATCH COUNT MISMATCH" << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// Run the pipeline over cheap lines with one slow line at the start, on
+// several parser and evaluator threads. While the slow batch is in progress
+// the other threads finish the batches after it, which the writer must hold
+// back; the credits must keep that backlog below the queue capacity.
+static int benchmarkPipeline(size_t lines) {
+    ExpressionPipeline::Options options;
+    options.batchSize = 16;
+    options.queueCapacity = 8;
+    options.parserThreads = 2;
+    options.evaluatorThreads = 2;
+    
+    std::string text = generateExpression(1024 * 1024) + "\n";
+    for (size_t i = 1; i < lines; ++i) {
+        text += (i % 2) ? "1 + 2 * 3\n" : "(7 - 2) % 3\n";
+    }
+    std::istringstream input(text);
+    std::ostringstream output;
+    ExpressionPipeline pipeline(options);
+    double time = timeMilliseconds([&]() { pipeline.run(input, output); });
+    
+    std::string result = output.str();
+    size_t outputLines = std::count(result.begin(), result.end(), '\n');
+    bool ordered = outputLines == lines && result.compare(result.find('\n') + 1, 4, "7\n2\n") == 0;
+    bool bounded = pipeline.getMaxHeldBack() < options.queueCapacity;
+    
+    std::cout << "Pipeline with one slow batch (" << lines << " lines, queue capacity "
+              << options.queueCapacity << ")" << std::endl;
+    std::cout << std::fixed << std::setprecision(1) << "  " << time << " ms, writer held back at most "
+              << pipeline.getMaxHeldBack() << " batches" << std::endl;
+    if (!ordered) {
+        std::cout << "  OUTPUT MISMATCH" << std::endl;
+    }
+    if (!bounded) {
+        std::cout << "  REORDER WINDOW EXCEEDED" << std::endl;
+    }
+    return (ordered && bounded) ? 0 : 1;
+}
+
+// Evaluate a flat machine-generated sum as parsed (a left-deep chain), after
+// rebalancing, and after rebalancing on several threads. Strict rebalancing
+// leaves the sum alone; a flat conjunction is rebalanced in either mode.
+// The parsed chain is evaluated recursively, so terms is limited by the stack.
+static int benchmarkRebalance(size_t terms) {
+    const int repetitions = 20;
+    ExpressionEvaluator evaluator;
+    std::string sum, conjunction;
+    for (size_t i = 0; i < terms; ++i) {
+        sum += (i ? " + " : "") + std::to_string(i % 97) + ".25";
+        conjunction += (i ? " && " : "") + std::to_string(i % 97 + 1);
+    }
+    // Node reference counts become atomic once any thread has started; start
+    // one now so the serial timings pay the same as the parallel ones
+    std::thread([]() {}).join();
+    
+    ExpressionTree chain = evaluator.buildExpressionTree(sum);
+    ExpressionTree strict = evaluator.rebalance(chain);
+    ExpressionTree balanced = evaluator.rebalance(chain, false);
+    
+    std::cout << "Rebalancing (" << terms << " terms)" << std::endl;
+    std::cout << "  height: parsed " << chain.getHeight() << ", strict " << strict.getHeight()
+              << ", relaxed " << balanced.getHeight() << std::endl;
+    
+    auto timeEvaluations = [&](const std::function<double()>& evaluate, double& result) {
+        return timeMilliseconds([&]() {
+            for (int r = 0; r < repetitions; ++r) result = evaluate();
+        }) / repetitions;
+    };
+    double chainResult = 0, balancedResult = 0;
+    double chainTime = timeEvaluations([&]() { return evaluator.evaluate(chain); }, chainResult);
+    double balancedTime = timeEvaluations([&]() { return evaluator.evaluate(balanced); }, balancedResult);
+    std::cout << std::fixed << std::setprecision(3)
+              << "  parsed:     " << chainTime << " ms  = " << std::setprecision(6) << chainResult << std::endl
+              << "  rebalanced: " << std::setprecision(3) << balancedTime << " ms  = " << std::setprecision(6)
+              << balancedResult << "  (relative difference " << std::scientific << std::setprecision(2)
+              << std::abs(balancedResult - chainResult) / std::abs(chainResult) << ")" << std::fixed << std::endl;
+    
+    bool consistent = true;
+    size_t maxThreads = std::max(2u, std::thread::hardware_concurrency());
+    for (size_t threads = 2; threads <= maxThreads; threads *= 2) {
+        double parallelResult = 0;
+        double parallelTime = timeEvaluations([&]() {
+            ExpressionEvaluator::Value value;
+            evaluator.tryEvaluateParallel(balanced, value, threads);
+            return value.toDouble();
+        }, parallelResult);
+        consistent = consistent && parallelResult == balancedResult;
+        std::cout << "  " << std::setw(2) << threads << " threads: " << std::setprecision(3) << parallelTime
+                  << " ms  speedup " << std::setprecision(2) << balancedTime / parallelTime << std::endl;
+    }
+    
+    ExpressionTree conjunctionChain = evaluator.buildExpressionTree(conjunction);
+    ExpressionTree conjunctionBalanced = evaluator.rebalance(conjunctionChain);
+    consistent = consistent && evaluator.evaluate(conjunctionChain) == evaluator.evaluate(conjunctionBalanced);
+    std::cout << "  conjunction height: parsed " << conjunctionChain.getHeight() << ", strict "
+              << conjunctionBalanced.getHeight() << std::endl;
+    
+    if (!consistent) {
+        std::cout << "  RESULT MISMATCH" << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// Connect to the evaluation server, returning -1 on failure
+static int connectToServer(const std::string& socketPath) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+    
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd >= 0 && connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+        close(fd);
+        fd = -1;
+    }
+    return fd;
+}
+
+// Send requests nested 200000 levels deep (a left-deep sum, a
+// chain of negations and nested parentheses), then a small one to check the
+// server survived them. Returns false and reports any wrong response.
+static bool checkDeepRequests(const std::string& socketPath) {
+    const size_t depth = 200000;
+    std::string sum = "1", negations(depth, '-'), parentheses(depth, '(');
+    for (size_t i = 1; i < depth; ++i) {
+        sum += "+1";
+    }
+    negations += "1";
+    parentheses += "1" + std::string(depth, ')');
+    const std::vector<std::pair<std::string, double>> requests = {
+        {sum, static_cast<double>(depth)}, {negations, 1}, {parentheses, 1}, {"5+3", 8}
+    };
+    
+    int fd = connectToServer(socketPath);
+    if (fd < 0) return false;
+    std::string request, input;
+    for (const auto& entry : requests) {
+        ExpressionServer::encodeRequest(request, entry.first);
+    }
+    for (size_t written = 0; written < request.size();) {
+        ssize_t count = send(fd, request.data() + written, request.size() - written, MSG_NOSIGNAL);
+        if (count <= 0) break;
+        written += count;
+    }
+    
+    bool passed = true;
+    size_t offset = 0;
+    char buffer[64 * 1024];
+    ExpressionServer::Response response;
+    for (const auto& entry : requests) {
+        while (!ExpressionServer::decodeResponse(input, offset, response)) {
+            ssize_t count = read(fd, buffer, sizeof(buffer));
+            if (count <= 0) {
+                std::cout << "  DEEP REQUEST FAILED: server closed the connection" << std::endl;
+                close(fd);
+                return false;
+            }
+            input.append(buffer, count);
+        }
+        if (response.status != ExpressionServer::STATUS_OK || response.value != entry.second) {
+            std::cout << "  DEEP REQUEST FAILED: " << entry.first.substr(0, 16) << "... ("
+                      << entry.first.size() << " chars) gave "
+                      << (response.status == ExpressionServer::STATUS_OK ? std::to_string(response.value)
+                                                                         : response.message) << std::endl;
+            passed = false;
+        }
+    }
+    close(fd);
+    return passed;
+}
+
+// Load generator for the evaluation server: each connection sends batches of
+// pipelined requests and waits for their responses; latency is per batch round
+// trip. Finally checks that deeply nested requests are answered.
+static int benchmarkServer(const std::string& socketPath, size_t connections,
+                           size_t requestsPerConnection, size_t pipelineDepth) {
+    const std::vector<std::string> workload = {
+        "5+3", "(5+3)*2", "10-4+7", "2^10 % 7", "(1 < 2) && (3 >= 3)", "255 & 15 | 64", "-(4*4) / 3"
+    };
+    std::vector<std::vector<double>> latencies(connections);
+    std::vector<size_t> errors(connections, 0);
+    std::vector<std::thread> clients;
+    
+    auto start = std::chrono::steady_clock::now();
+    for (size_t c = 0; c < connections; ++c) {
+        clients.emplace_back([&, c]() {
+            int fd = connectToServer(socketPath);
+            if (fd < 0) {
+                errors[c] = requestsPerConnection;
+                return;
+            }
+            std::string request, input;
+            char buffer[64 * 1024];
+            
+            for (size_t sent = 0; sent < requestsPerConnection; sent += pipelineDepth) {
+                size_t batch = std::min(pipelineDepth, requestsPerConnection - sent);
+                request.clear();
+                for (size_t i = 0; i < batch; ++i) {
+                    ExpressionServer::encodeRequest(request, workload[(sent + i) % workload.size()]);
+                }
+                
+                auto batchStart = std::chrono::steady_clock::now();
+                if (write(fd, request.data(), request.size()) != static_cast<ssize_t>(request.size())) break;
+                
+                size_t received = 0, offset = 0;
+                ExpressionServer::Response response;
+                input.clear();
+                while (received < batch) {
+                    if (!ExpressionServer::decodeResponse(input, offset, response)) {
+                        ssize_t count = read(fd, buffer, sizeof(buffer));
+                        if (count <= 0) break;
+                        input.append(buffer, count);
+                        continue;
+                    }
+                    if (response.status != ExpressionServer::STATUS_OK) ++errors[c];
+                    ++received;
+                }
+                if (received < batch) break;
+                
+                double elapsed = std::chrono::duration<double, std::micro>(
+                    std::chrono::steady_clock::now() - batchStart).count();
+                latencies[c].insert(latencies[c].end(), batch, elapsed);
+            }
+            close(fd);
+        });
+    }
+    for (auto& client : clients) {
+        client.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    
+    std::vector<double> all;
+    size_t errorCount = 0;
+    for (size_t c = 0; c < connections; ++c) {
+        all.insert(all.end(), latencies[c].begin(), latencies[c].end());
+        errorCount += errors[c];
+    }
+    if (all.empty()) {
+        std::cerr << "Error: no responses from " << socketPath << std::endl;
+        return 1;
+    }
+    std::sort(all.begin(), all.end());
+    
+    std::cout << "Server load (" << connections << " connections, pipeline depth " << pipelineDepth << ")" << std::endl;
+    std::cout << std::fixed << std::setprecision(1)
+              << "  requests: " << all.size() << "  errors: " << errorCount << std::endl
+              << "  req/s:    " << all.size() / seconds << std::endl
+              << "  p50:      " << all[all.size() / 2] << " us" << std::endl
+              << "  p99:      " << all[std::min(all.size() - 1, all.size() * 99 / 100)] << " us" << std::endl;
+    
+    bool deepPassed = checkDeepRequests(socketPath);
+    std::cout << "  deep requests: " << (deepPassed ? "ok" : "failed") << std::endl;
+    return deepPassed ? 0 : 1;
+}
+
+/**
+ * Usage:
+ *   benchmark parse [length]
+ *   benchmark oneshot [iterations]
+ *   benchmark concurrent [evaluations-per-thread]
+ *   benchmark filter [rows]
+ *   benchmark rebalance [terms]
+ *   benchmark pipeline [lines]
+ *   benchmark load [socket-path] [connections] [requests-per-connection] [pipeline-depth]
+ */
+int main(int argc, char* argv[]) {
+    std::string mode = (argc > 1) ? argv[1] : "parse";
+    
+    if (mode == "parse") {
+        benchmarkParallelParse((argc > 2) ? std::stoul(argv[2]) : 16 * 1024 * 1024);
+    } else if (mode == "oneshot") {
+        return benchmarkOneShot((argc > 2) ? std::stoul(argv[2]) : 200000);
+    } else if (mode == "concurrent") {
+        return benchmarkConcurrent((argc > 2) ? std::stoul(argv[2]) : 2000000);
+    } else if (mode == "filter") {
+        return benchmarkFilter((argc > 2) ? std::stoul(argv[2]) : 4000000);
+    } else if (mode == "rebalance") {
+        return benchmarkRebalance((argc > 2) ? std::stoul(argv[2]) : 20000);
+    } else if (mode == "pipeline") {
+        return benchmarkPipeline((argc > 2) ? std::stoul(argv[2]) : 200000);
+    } else if (mode == "load") {
+        return benchmarkServer((argc > 2) ? argv[2] : "/tmp/expression-evaluator.sock",
+                               (argc > 3) ? std::stoul(argv[3]) : 4,
+                               (argc > 4) ? std::stoul(argv[4]) : 100000,
+                               (argc > 5) ? std::stoul(argv[5]) : 32);
+    } else {
+        std::cerr << "Unknown benchmark '" << mode << "'" << std::endl;
+        return 1;
+    }
+    return 0;
+}
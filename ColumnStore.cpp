@@ -0,0 +1,385 @@
+#include "ColumnStore.hpp"
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+[[noreturn]] void throwSystemError(const std::string& what) {
+    throw std::system_error(errno, std::generic_category(), what);
+}
+
+size_t resolveThreads(size_t threadCount) {
+    return threadCount ? threadCount : std::max(1u, std::thread::hardware_concurrency());
+}
+
+// Run body(t) for t in [0, threadCount) on separate threads
+template <typename Body>
+void runThreads(size_t threadCount, Body body) {
+    std::vector<std::thread> workers;
+    for (size_t t = 1; t < threadCount; ++t) {
+        workers.emplace_back(body, t);
+    }
+    body(0);
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+// Raw column files are little-endian; swap on big-endian hosts
+template <typename T>
+T fromLittleEndian(const unsigned char* bytes) {
+    T value;
+    std::memcpy(&value, bytes, sizeof(T));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    uint64_t swapped;
+    std::memcpy(&swapped, &value, sizeof(T));
+    swapped = __builtin_bswap64(swapped);
+    std::memcpy(&value, &swapped, sizeof(T));
+#endif
+    return value;
+}
+
+bool isBlank(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+// Trim blanks from both ends of [begin, end)
+void trim(const char*& begin, const char*& end) {
+    while (begin < end && isBlank(*begin)) ++begin;
+    while (end > begin && isBlank(end[-1])) --end;
+}
+
+// End of the line starting at begin (its '\n', or end)
+const char* lineEnd(const char* begin, const char* end) {
+    const char* newline = static_cast<const char*>(std::memchr(begin, '\n', end - begin));
+    return newline ? newline : end;
+}
+
+// Start of the line after the one ending at lineEnd
+const char* nextLine(const char* lineEnd, const char* end) {
+    return lineEnd < end ? lineEnd + 1 : end;
+}
+
+bool isBlankLine(const char* begin, const char* end) {
+    trim(begin, end);
+    return begin == end;
+}
+
+} // namespace
+
+ColumnStore::ColumnStore() : rowCount(0) {
+}
+
+ColumnStore::~ColumnStore() {
+    for (const Mapping& mapping : mappings) {
+        munmap(mapping.address, mapping.length);
+    }
+}
+
+// Map a whole file read-only
+ColumnStore::Mapping ColumnStore::mapFile(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) throwSystemError("open " + path);
+
+    struct stat status;
+    if (fstat(fd, &status) < 0) {
+        int error = errno;
+        close(fd);
+        errno = error;
+        throwSystemError("stat " + path);
+    }
+    Mapping mapping{nullptr, static_cast<size_t>(status.st_size)};
+    if (mapping.length > 0) {
+        mapping.address = mmap(nullptr, mapping.length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping.address == MAP_FAILED) {
+            int error = errno;
+            close(fd);
+            errno = error;
+            throwSystemError("mmap " + path);
+        }
+        // Columns are read front to back
+        madvise(mapping.address, mapping.length, MADV_SEQUENTIAL);
+    }
+    close(fd);
+    return mapping;
+}
+
+// Register a column
+void ColumnStore::addColumn(const std::string& name, Format format, const void* data, size_t rows) {
+    if (hasColumn(name)) {
+        throw std::invalid_argument("Duplicate column '" + name + "'");
+    }
+    if (!columns.empty() && rows != rowCount) {
+        throw std::invalid_argument("Column '" + name + "' has " + std::to_string(rows) + " rows, expected " +
+                                    std::to_string(rowCount));
+    }
+    rowCount = rows;
+    columns.push_back(Column{name, format, static_cast<const unsigned char*>(data)});
+}
+
+// Map a raw column file; its values are used in place
+void ColumnStore::mapColumn(const std::string& name, const std::string& path, Format format) {
+    Mapping mapping = mapFile(path);
+    if (mapping.address) {
+        mappings.push_back(mapping);
+    }
+    if (mapping.length % 8 != 0) {
+        throw std::invalid_argument("Column file " + path + " is not a whole number of 8-byte values");
+    }
+    addColumn(name, format, mapping.address, mapping.length / 8);
+}
+
+// Parse a CSV file in parallel:
+//   1. split the body into one range per thread at line boundaries
+//   2. count the rows of each range; a prefix sum gives each range its first row
+//   3. parse every range straight into its rows of the columns, counting
+//      bad fields; any bad field fails the whole load
+void ColumnStore::loadCsv(const std::string& path, size_t threadCount) {
+    Mapping mapping = mapFile(path);
+    if (mapping.address) {
+        mappings.push_back(mapping);
+    }
+    const char* text = static_cast<const char*>(mapping.address);
+    const char* end = text + mapping.length;
+
+    // Header: the column names
+    const char* headerEnd = text ? lineEnd(text, end) : end;
+    std::vector<std::string> names;
+    for (const char* field = text; field;) {
+        const char* comma = std::find(field, headerEnd, ',');
+        const char* nameBegin = field;
+        const char* nameEnd = comma;
+        trim(nameBegin, nameEnd);
+        if (nameBegin == nameEnd) {
+            throw std::invalid_argument("CSV file " + path + " has an empty column name");
+        }
+        names.emplace_back(nameBegin, nameEnd);
+        field = (comma < headerEnd) ? comma + 1 : nullptr;
+    }
+    if (names.empty()) {
+        throw std::invalid_argument("CSV file " + path + " has no header");
+    }
+
+    const char* body = nextLine(headerEnd, end);
+    // Small files are not worth a thread per 4 KiB
+    size_t bodyLength = end - body;
+    threadCount = std::max<size_t>(1, std::min(resolveThreads(threadCount), bodyLength / 4096));
+    std::vector<const char*> bounds(threadCount + 1, end);
+    bounds[0] = body;
+    for (size_t t = 1; t < threadCount; ++t) {
+        const char* split = std::max(bounds[t - 1], body + bodyLength * t / threadCount);
+        bounds[t] = nextLine(lineEnd(split, end), end);
+    }
+
+    std::vector<size_t> firstRow(threadCount + 1, 0);
+    runThreads(threadCount, [&](size_t t) {
+        size_t rows = 0;
+        for (const char* line = bounds[t]; line < bounds[t + 1];) {
+            const char* next = lineEnd(line, bounds[t + 1]);
+            rows += !isBlankLine(line, next);
+            line = nextLine(next, bounds[t + 1]);
+        }
+        firstRow[t + 1] = rows;
+    });
+    for (size_t t = 0; t < threadCount; ++t) {
+        firstRow[t + 1] += firstRow[t];
+    }
+
+    std::vector<double*> targets;
+    for (size_t i = 0; i < names.size(); ++i) {
+        parsed.emplace_back(firstRow[threadCount], std::nan(""));
+        targets.push_back(parsed.back().data());
+    }
+    // Fields that are missing, not a number, or beyond the last column, per
+    // thread; column names.size() stands for a field beyond the last column
+    struct BadFields {
+        size_t count = 0;
+        size_t row = 0;         // First bad field
+        size_t column = 0;
+    };
+    std::vector<BadFields> bad(threadCount);
+    runThreads(threadCount, [&](size_t t) {
+        size_t row = firstRow[t];
+        auto reject = [&bad, t, &row](size_t column) {
+            if (bad[t].count++ == 0) {
+                bad[t].row = row;
+                bad[t].column = column;
+            }
+        };
+        for (const char* line = bounds[t]; line < bounds[t + 1];) {
+            const char* next = lineEnd(line, bounds[t + 1]);
+            if (!isBlankLine(line, next)) {
+                const char* field = line;
+                size_t i = 0;
+                for (; i < names.size() && field; ++i) {
+                    const char* comma = std::find(field, next, ',');
+                    const char* valueBegin = field;
+                    const char* valueEnd = comma;
+                    trim(valueBegin, valueEnd);
+                    double value;
+                    auto parsedValue = std::from_chars(valueBegin, valueEnd, value);
+                    if (valueBegin != valueEnd && parsedValue.ec == std::errc() && parsedValue.ptr == valueEnd) {
+                        targets[i][row] = value;
+                    } else {
+                        reject(i);
+                    }
+                    field = (comma < next) ? comma + 1 : nullptr;
+                }
+                for (; i < names.size(); ++i) {
+                    reject(i);
+                }
+                if (field) {
+                    reject(names.size());
+                }
+                ++row;
+            }
+            line = nextLine(next, bounds[t + 1]);
+        }
+    });
+
+    // Corrupt input must not reach the results as NaN rows
+    size_t badCount = 0;
+    const BadFields* first = nullptr;
+    for (const BadFields& range : bad) {
+        if (range.count && !first) first = &range;
+        badCount += range.count;
+    }
+    if (first) {
+        for (size_t i = 0; i < names.size(); ++i) {
+            parsed.pop_back();
+        }
+        std::string where = (first->column < names.size()) ? "column '" + names[first->column] + "'"
+                                                           : "a field beyond the last column";
+        throw std::invalid_argument("CSV file " + path + " has " + std::to_string(badCount) +
+                                    " missing or malformed field(s), the first in " + where +
+                                    " of data row " + std::to_string(first->row + 1));
+    }
+
+    auto column = parsed.end();
+    std::advance(column, -static_cast<long>(names.size()));
+    for (const std::string& name : names) {
+        addColumn(name, FLOAT64, (column++)->data(), firstRow[threadCount]);
+    }
+}
+
+bool ColumnStore::hasColumn(const std::string& name) const {
+    return std::any_of(columns.begin(), columns.end(), [&name](const Column& column) { return column.name == name; });
+}
+
+// Value of a row as the evaluator sees it: int64 values stay exact
+ExpressionEvaluator::Value ColumnStore::valueAt(const Column& column, size_t row) {
+    const unsigned char* bytes = column.data + 8 * row;
+    if (column.format == INT64) {
+        return ExpressionEvaluator::Value{true, fromLittleEndian<int64_t>(bytes), 0};
+    }
+    return ExpressionEvaluator::Value{false, 0, fromLittleEndian<double>(bytes)};
+}
+
+// Evaluate an expression over every row. Threads take whole 64-row words
+// of the error bitmap, so they never write to the same word.
+ExpressionEvaluator::BatchResult ColumnStore::evaluate(const CompiledExpression& expression,
+                                                       size_t threadCount) const {
+    std::vector<const Column*> bound;
+    for (const std::string& name : expression.getVariables()) {
+        auto column = std::find_if(columns.begin(), columns.end(),
+                                   [&name](const Column& candidate) { return candidate.name == name; });
+        if (column == columns.end()) {
+            throw std::invalid_argument("No column for variable '" + name + "'");
+        }
+        bound.push_back(&*column);
+    }
+
+    ExpressionEvaluator::BatchResult result;
+    result.values.resize(rowCount);
+    result.errors.assign(rowCount, ExpressionError::NONE);
+    result.errorBitmap.assign((rowCount + 63) / 64, 0);
+    result.integers.assign(rowCount, 0);
+    result.integerBitmap.assign((rowCount + 63) / 64, 0);
+
+    size_t words = result.errorBitmap.size();
+    threadCount = std::max<size_t>(1, std::min(resolveThreads(threadCount), words));
+    std::atomic<size_t> errorCount{0};
+    runThreads(threadCount, [&](size_t t) {
+        std::vector<ExpressionEvaluator::Value> values(bound.size());
+        size_t errors = 0;
+        size_t first = 64 * (words * t / threadCount);
+        size_t last = std::min(rowCount, 64 * (words * (t + 1) / threadCount));
+        for (size_t row = first; row < last; ++row) {
+            for (size_t i = 0; i < bound.size(); ++i) {
+                values[i] = valueAt(*bound[i], row);
+            }
+            ExpressionEvaluator::Value value;
+            ExpressionError::Code error = expression.evaluate(values.data(), value);
+            result.values[row] = value.toDouble();
+            if (error == ExpressionError::NONE && value.isInteger) {
+                result.integers[row] = value.integer;
+                result.integerBitmap[row / 64] |= uint64_t(1) << (row % 64);
+            }
+            if (error != ExpressionError::NONE) {
+                result.errors[row] = error;
+                result.errorBitmap[row / 64] |= uint64_t(1) << (row % 64);
+                ++errors;
+            }
+        }
+        errorCount += errors;
+    });
+    result.errorCount = errorCount;
+    return result;
+}
+
+// Write the results as a raw little-endian float64 column
+void ColumnStore::writeBinary(const ExpressionEvaluator::BatchResult& result, const std::string& path) {
+    std::ofstream output(path, std::ios::binary);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    for (double value : result.values) {
+        uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        bits = __builtin_bswap64(bits);
+        output.write(reinterpret_cast<const char*>(&bits), sizeof(bits));
+    }
+#else
+    output.write(reinterpret_cast<const char*>(result.values.data()), result.values.size() * sizeof(double));
+#endif
+    if (!output) {
+        throw std::system_error(errno, std::generic_category(), "write " + path);
+    }
+}
+
+// Write one line per row. Rows are formatted by several threads a block at
+// a time and written in order.
+void ColumnStore::writeText(const ExpressionEvaluator::BatchResult& result, std::ostream& output,
+                            size_t threadCount) {
+    const size_t BLOCK_ROWS = 64 * 1024;
+    threadCount = resolveThreads(threadCount);
+    std::vector<std::string> blocks(threadCount);
+
+    for (size_t start = 0; start < result.values.size(); start += BLOCK_ROWS * threadCount) {
+        runThreads(threadCount, [&](size_t t) {
+            std::string& block = blocks[t];
+            block.clear();
+            size_t first = std::min(result.values.size(), start + BLOCK_ROWS * t);
+            size_t last = std::min(result.values.size(), first + BLOCK_ROWS);
+            for (size_t row = first; row < last; ++row) {
+                if (result.errors[row] != ExpressionError::NONE) {
+                    block += ExpressionError::message(result.errors[row]);
+                } else {
+                    block += ExpressionEvaluator::formatResult(result.valueAt(row));
+                }
+                block += '\n';
+            }
+        });
+        for (const std::string& block : blocks) {
+            output.write(block.data(), block.size());
+        }
+    }
+}
@@ -0,0 +1,92 @@
+#ifndef COLUMN_STORE_HPP
+#define COLUMN_STORE_HPP
+
+#include "CompiledExpression.hpp"
+#include <string>
+#include <vector>
+#include <list>
+#include <iostream>
+#include <cstddef>
+
+/**
+ * Named input columns for evaluating one expression over many rows
+ *
+ * Raw column files hold little-endian float64 or int64 values back to back.
+ * They are memory-mapped read-only and read in place: nothing is copied,
+ * int64 values are bound as exact integers as each row is evaluated, so
+ * operators evaluated on integers (e.g. v & 255, v == 9007199254740993) and
+ * the text output see every bit even above 2^53. CSV files
+ * (a header line of column names, then one row per line) are mapped and
+ * their fields parsed by several threads into owned columns.
+ *
+ * All columns must have the same number of rows.
+ */
+class ColumnStore {
+public:
+    enum Format {
+        FLOAT64,
+        INT64
+    };
+
+    ColumnStore();
+    ~ColumnStore();
+    ColumnStore(const ColumnStore&) = delete;
+    ColumnStore& operator=(const ColumnStore&) = delete;
+
+    // Map a raw column file. Throws std::system_error if it cannot be
+    // mapped, std::invalid_argument if its size is not a whole number of
+    // values or differs from the other columns, or the name is taken.
+    void mapColumn(const std::string& name, const std::string& path, Format format);
+
+    // Load every column of a CSV file. threadCount 0 means hardware
+    // concurrency. Throws std::invalid_argument, naming the first one and
+    // counting them all, if any field is missing, is not a number, or is
+    // beyond the last header column.
+    void loadCsv(const std::string& path, size_t threadCount = 0);
+
+    size_t getRowCount() const { return rowCount; }
+    bool hasColumn(const std::string& name) const;
+
+    // Evaluate expression for every row, binding each of its variables to
+    // the column of that name (std::invalid_argument if there is none).
+    // Integer results are kept exact in result.integers. Rows are split over
+    // threadCount threads.
+    ExpressionEvaluator::BatchResult evaluate(const CompiledExpression& expression, size_t threadCount = 0) const;
+
+    // Write results as a raw little-endian float64 column (NaN for failed
+    // rows; integers beyond 2^53 are rounded to the nearest double)
+    static void writeBinary(const ExpressionEvaluator::BatchResult& result, const std::string& path);
+
+    // Write one line per row: the formatted result (exact for integers) or
+    // the error message
+    static void writeText(const ExpressionEvaluator::BatchResult& result, std::ostream& output,
+                          size_t threadCount = 0);
+
+private:
+    struct Column {
+        std::string name;
+        Format format;
+        const unsigned char* data;      // rowCount values of format
+    };
+
+    struct Mapping {
+        void* address;
+        size_t length;
+    };
+
+    // Map a whole file read-only; an empty file maps to nullptr
+    static Mapping mapFile(const std::string& path);
+
+    // Register a column, checking its name and row count
+    void addColumn(const std::string& name, Format format, const void* data, size_t rows);
+
+    // Value of a row of a column as the evaluator sees it
+    static ExpressionEvaluator::Value valueAt(const Column& column, size_t row);
+
+    std::vector<Column> columns;
+    std::vector<Mapping> mappings;              // Unmapped on destruction
+    std::list<std::vector<double>> parsed;      // CSV columns (stable addresses)
+    size_t rowCount;
+};
+
+#endif // COLUMN_STORE_HPP
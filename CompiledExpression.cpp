@@ -0,0 +1,176 @@
+#include "CompiledExpression.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Operand pushed for a variable
+ExpressionEvaluator::Value load(double value) { return ExpressionEvaluator::Value{false, 0, value}; }
+ExpressionEvaluator::Value load(const ExpressionEvaluator::Value& value) { return value; }
+
+} // namespace
+
+CompiledExpression::CompiledExpression() : program(std::make_shared<Program>()) {
+}
+
+// Parse and compile an expression
+CompiledExpression::CompiledExpression(const ExpressionEvaluator& evaluator, const std::string& expression)
+    : CompiledExpression(evaluator, evaluator.buildExpressionTree(expression)) {
+}
+
+// Compile a parsed tree into postfix instructions
+CompiledExpression::CompiledExpression(const ExpressionEvaluator& evaluator, const ExpressionTree& tree) {
+    auto compiled = std::make_shared<Program>();
+    if (tree.getRoot()) {
+        compileNode(tree.getRoot(), evaluator.getOperators(), *compiled);
+    }
+    program = compiled;
+}
+
+// Emit the instructions of a subtree in postorder, the order in which the
+// tree evaluator visits it, so errors are reported for the same node. The
+// walk uses an explicit stack: a parsed chain is as deep as it is long.
+void CompiledExpression::compileNode(const NodePtr& root, const OperatorRegistry& operators, Program& program) {
+    // An operator node is visited twice: first to push its operands, then,
+    // with op set, to emit the operator itself
+    struct Visit {
+        const Node* node;
+        const OperatorDescriptor* op;
+    };
+    std::vector<Visit> pending = {{root.get(), nullptr}};
+    size_t depth = 0;
+
+    while (!pending.empty()) {
+        Visit visit = pending.back();
+        pending.pop_back();
+        const Node* node = visit.node;
+        Instruction instruction{};
+
+        if (!node) {
+            instruction.kind = Instruction::FAIL;
+            instruction.error = ExpressionError::NULL_NODE;
+        } else if (node->isOperand()) {
+            instruction.kind = Instruction::PUSH;
+            instruction.isInteger = node->isInteger();
+            instruction.constant = node->isInteger() ? ExpressionEvaluator::Value{true, node->getIntegerValue(), 0}
+                                                     : ExpressionEvaluator::Value{false, 0, node->getValue()};
+        } else if (node->isVariable()) {
+            auto it = std::find(program.variables.begin(), program.variables.end(), node->getName());
+            instruction.kind = Instruction::LOAD;
+            instruction.slot = it - program.variables.begin();
+            if (it == program.variables.end()) {
+                program.variables.push_back(node->getName());
+            }
+        } else if (visit.op) {
+            instruction.kind = node->isUnaryOp() ? Instruction::UNARY : Instruction::BINARY;
+            instruction.op = *visit.op;
+            instruction.isInteger = node->isInteger();
+            depth -= node->isUnaryOp() ? 1 : 2;
+        } else {
+            const OperatorDescriptor* op = node->isUnaryOp() ? operators.findUnary(node->getOperator())
+                                                             : operators.find(node->getOperator());
+            if (op) {
+                pending.push_back({node, op});
+                pending.push_back({node->getRight().get(), nullptr});
+                if (!node->isUnaryOp()) {
+                    pending.push_back({node->getLeft().get(), nullptr});
+                }
+                continue;
+            }
+            // The tree evaluator reports this before visiting the operands
+            instruction.kind = Instruction::FAIL;
+            instruction.error = ExpressionError::UNKNOWN_OPERATOR;
+            instruction.isInteger = node->isInteger();
+        }
+
+        program.code.push_back(instruction);
+        program.maxDepth = std::max(program.maxDepth, ++depth);
+    }
+}
+
+// Evaluate with double variables
+ExpressionError::Code CompiledExpression::evaluate(const double* variables, ExpressionEvaluator::Value& result) const {
+    return run(variables, result);
+}
+
+// Evaluate with typed variables
+ExpressionError::Code CompiledExpression::evaluate(const ExpressionEvaluator::Value* variables,
+                                                   ExpressionEvaluator::Value& result) const {
+    return run(variables, result);
+}
+
+// Run the postfix program on this thread's scratch stack
+template <typename Variable>
+ExpressionError::Code CompiledExpression::run(const Variable* variables, ExpressionEvaluator::Value& result) const {
+    using Value = ExpressionEvaluator::Value;
+
+    // Grown to the deepest program this thread has evaluated, then reused
+    thread_local std::vector<Value> scratch;
+    if (scratch.size() < program->maxDepth) {
+        scratch.resize(program->maxDepth);
+    }
+    Value* stack = scratch.data();
+    size_t top = 0;
+    ExpressionError::Code error = ExpressionError::NONE;
+
+    for (const Instruction& instruction : program->code) {
+        switch (instruction.kind) {
+        case Instruction::PUSH:
+            stack[top++] = instruction.constant;
+            break;
+        case Instruction::LOAD:
+            if (!variables) {
+                error = ExpressionError::UNKNOWN_VARIABLE;
+                break;
+            }
+            stack[top++] = load(variables[instruction.slot]);
+            break;
+        case Instruction::UNARY: {
+            Value& operand = stack[top - 1];
+            if (instruction.isInteger) {
+                operand = ExpressionEvaluator::applyIntegerUnary(instruction.op, operand, error);
+            } else {
+                operand = Value{false, 0, ExpressionEvaluator::applyUnary(instruction.op, operand.toDouble(), error)};
+            }
+            break;
+        }
+        case Instruction::BINARY: {
+            Value& left = stack[top - 2];
+            const Value& right = stack[top - 1];
+            if (instruction.isInteger) {
+                left = ExpressionEvaluator::applyIntegerBinary(instruction.op, left, right, error);
+            } else {
+                left = Value{false, 0, ExpressionEvaluator::applyBinary(instruction.op, left.toDouble(),
+                                                                        right.toDouble(), error)};
+            }
+            --top;
+            break;
+        }
+        case Instruction::FAIL:
+            error = instruction.error;
+            break;
+        }
+
+        if (error != ExpressionError::NONE) {
+            result = Value{false, 0, std::nan("")};
+            return error;
+        }
+    }
+
+    if (top != 1) {
+        result = Value{false, 0, std::nan("")};
+        return ExpressionError::NULL_NODE;
+    }
+    result = stack[0];
+    return ExpressionError::NONE;
+}
+
+// Evaluate, throwing ExpressionError on failure
+double CompiledExpression::evaluate(const double* variables) const {
+    ExpressionEvaluator::Value result;
+    ExpressionError::Code error = evaluate(variables, result);
+    if (error != ExpressionError::NONE) {
+        throw ExpressionError(error);
+    }
+    return result.toDouble();
+}
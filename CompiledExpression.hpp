@@ -0,0 +1,80 @@
+#ifndef COMPILED_EXPRESSION_HPP
+#define COMPILED_EXPRESSION_HPP
+
+#include "ExpressionEvaluator.hpp"
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstddef>
+
+/**
+ * An expression compiled to an immutable postfix program
+ *
+ * The program is built once from a parse tree (operator descriptors and
+ * inferred node types are copied in), after which it is never modified:
+ * copies share it, and any number of threads may evaluate the same
+ * CompiledExpression at once without locking. Evaluation keeps its operand
+ * stack in thread-local scratch space and variables are passed per call, so
+ * there is no shared mutable state. Results and error codes match
+ * ExpressionEvaluator::tryEvaluate on the same tree.
+ */
+class CompiledExpression {
+public:
+    // An empty expression; evaluating it reports NULL_NODE
+    CompiledExpression();
+
+    // Parse and compile with the operators of evaluator; throws ExpressionError
+    CompiledExpression(const ExpressionEvaluator& evaluator, const std::string& expression);
+
+    // Compile a parsed tree
+    CompiledExpression(const ExpressionEvaluator& evaluator, const ExpressionTree& tree);
+
+    // Variable names in order of first appearance; evaluate() takes their
+    // values in the same order
+    const std::vector<std::string>& getVariables() const { return program->variables; }
+
+    // Evaluate without throwing. variables may be null if there are none.
+    ExpressionError::Code evaluate(const double* variables, ExpressionEvaluator::Value& result) const;
+
+    // Evaluate with typed variable values: integer values stay exact wherever
+    // the operators they feed are evaluated as integers (e.g. v & 255)
+    ExpressionError::Code evaluate(const ExpressionEvaluator::Value* variables,
+                                   ExpressionEvaluator::Value& result) const;
+
+    // Evaluate, throwing ExpressionError on failure
+    double evaluate(const double* variables = nullptr) const;
+
+private:
+    struct Instruction {
+        enum Kind {
+            PUSH,       // Push constant
+            LOAD,       // Push variables[slot]
+            UNARY,      // Apply op to the top of the stack
+            BINARY,     // Apply op to the two topmost values
+            FAIL        // Stop with error (unknown operator or missing node)
+        };
+        Kind kind;
+        bool isInteger;                     // Inferred type of the node
+        ExpressionEvaluator::Value constant;
+        size_t slot;
+        OperatorDescriptor op;
+        ExpressionError::Code error;
+    };
+
+    struct Program {
+        std::vector<Instruction> code;
+        std::vector<std::string> variables;
+        size_t maxDepth = 0;                // Deepest operand stack the code needs
+    };
+
+    // Append the instructions of a subtree in postorder
+    static void compileNode(const NodePtr& root, const OperatorRegistry& operators, Program& program);
+
+    // Run the program with variables of type double or Value
+    template <typename Variable>
+    ExpressionError::Code run(const Variable* variables, ExpressionEvaluator::Value& result) const;
+
+    std::shared_ptr<const Program> program;
+};
+
+#endif // COMPILED_EXPRESSION_HPP
@@ -0,0 +1,404 @@
+#include "ExpressionCompiler.hpp"
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <climits>
+
+namespace {
+
+// Runtime support emitted into every generated source. It mirrors the
+// evaluator: integer Values use overflow-checked int64 kernels and fall back
+// to double, and the first error raised in evaluation order is kept.
+const char* PRELUDE = R"(struct Value {
+    bool isInteger;
+    long long integer;
+    double real;
+};
+
+inline Value integer(long long value) { return Value{true, value, 0}; }
+inline Value real(double value) { return Value{false, 0, value}; }
+inline double toDouble(Value value) { return value.isInteger ? static_cast<double>(value.integer) : value.real; }
+inline bool isTrue(Value value) { return value.isInteger ? value.integer != 0 : value.real != 0; }
+
+inline double fail(int& error, int code) {
+    if (error == 0) error = code;
+    return std::nan("");
+}
+inline Value failValue(int& error, int code) { return real(fail(error, code)); }
+
+inline long long bits(Value value, int& error) {
+    if (value.isInteger) return value.integer;
+    if (!(value.real >= -9223372036854775808.0 && value.real < 9223372036854775808.0)) {
+        fail(error, BITWISE_OUT_OF_RANGE);
+        return 0;
+    }
+    return static_cast<long long>(value.real);
+}
+
+inline double divide(double a, double b, int& error) { return b == 0 ? fail(error, DIVISION_BY_ZERO) : a / b; }
+inline double modulo(double a, double b, int& error) { return b == 0 ? fail(error, MODULO_BY_ZERO) : std::fmod(a, b); }
+
+inline Value add(Value a, Value b, int&) {
+    long long r;
+    if (a.isInteger && b.isInteger && !__builtin_add_overflow(a.integer, b.integer, &r)) return integer(r);
+    return real(toDouble(a) + toDouble(b));
+}
+inline Value subtract(Value a, Value b, int&) {
+    long long r;
+    if (a.isInteger && b.isInteger && !__builtin_sub_overflow(a.integer, b.integer, &r)) return integer(r);
+    return real(toDouble(a) - toDouble(b));
+}
+inline Value multiply(Value a, Value b, int&) {
+    long long r;
+    if (a.isInteger && b.isInteger && !__builtin_mul_overflow(a.integer, b.integer, &r)) return integer(r);
+    return real(toDouble(a) * toDouble(b));
+}
+inline Value modulo(Value a, Value b, int& error) {
+    if (a.isInteger && b.isInteger) {
+        if (b.integer == 0) return failValue(error, MODULO_BY_ZERO);
+        return integer(b.integer == -1 ? 0 : a.integer % b.integer);
+    }
+    return real(modulo(toDouble(a), toDouble(b), error));
+}
+inline Value power(Value a, Value b, int&) {
+    if (a.isInteger && b.isInteger && b.integer >= 0) {
+        long long base = a.integer, exponent = b.integer, r = 1;
+        bool overflow = false;
+        while (exponent > 0 && !overflow) {
+            if (exponent & 1) overflow = __builtin_mul_overflow(r, base, &r);
+            exponent >>= 1;
+            if (exponent > 0 && !overflow) overflow = __builtin_mul_overflow(base, base, &base);
+        }
+        if (!overflow) return integer(r);
+    }
+    return real(std::pow(toDouble(a), toDouble(b)));
+}
+
+#define COMPARISON(name, op) \
+    inline Value name(Value a, Value b, int&) { \
+        return integer(a.isInteger && b.isInteger ? a.integer op b.integer : toDouble(a) op toDouble(b)); \
+    }
+COMPARISON(equal, ==)
+COMPARISON(notEqual, !=)
+COMPARISON(less, <)
+COMPARISON(greater, >)
+COMPARISON(lessEqual, <=)
+COMPARISON(greaterEqual, >=)
+#undef COMPARISON
+
+inline Value logicalAnd(Value a, Value b, int&) { return integer(isTrue(a) && isTrue(b)); }
+inline Value logicalOr(Value a, Value b, int&) { return integer(isTrue(a) || isTrue(b)); }
+inline Value bitAnd(Value a, Value b, int& error) { return integer(bits(a, error) & bits(b, error)); }
+inline Value bitOr(Value a, Value b, int& error) { return integer(bits(a, error) | bits(b, error)); }
+inline Value bitXor(Value a, Value b, int& error) { return integer(bits(a, error) ^ bits(b, error)); }
+inline Value shiftLeft(Value a, Value b, int& error) {
+    long long x = bits(a, error), y = bits(b, error);
+    if (y < 0 || y > 63) return failValue(error, SHIFT_OUT_OF_RANGE);
+    return integer(static_cast<long long>(static_cast<unsigned long long>(x) << y));
+}
+inline Value shiftRight(Value a, Value b, int& error) {
+    long long x = bits(a, error), y = bits(b, error);
+    if (y < 0 || y > 63) return failValue(error, SHIFT_OUT_OF_RANGE);
+    return integer(x >> y);
+}
+
+inline Value negate(Value a, int&) {
+    if (a.isInteger && a.integer != LLONG_MIN) return integer(-a.integer);
+    return real(-toDouble(a));
+}
+inline Value bitNot(Value a, int& error) { return integer(~bits(a, error)); }
+inline Value logicalNot(Value a, int&) { return integer(!isTrue(a)); }
+)";
+
+// Prelude function implementing an INTEGER-typed built-in operator, by id
+const char* valueFunction(const OperatorDescriptor* op) {
+    static const char* const functions[OperatorDescriptor::USER] = {
+        "add", "subtract", "multiply", nullptr, "modulo", "power",
+        "equal", "notEqual", "less", "greater", "lessEqual", "greaterEqual",
+        "logicalAnd", "logicalOr", "bitAnd", "bitOr", "bitXor", "shiftLeft", "shiftRight",
+        "negate", "bitNot", "logicalNot"
+    };
+    return (op && op->id < OperatorDescriptor::USER) ? functions[op->id] : nullptr;
+}
+
+// Exact C++ spelling of a double
+std::string doubleLiteral(double value) {
+    if (std::isnan(value)) return "std::nan(\"\")";
+    if (std::isinf(value)) return value > 0 ? "HUGE_VAL" : "(-HUGE_VAL)";
+    std::ostringstream ss;
+    ss << std::hexfloat << value;
+    return "(" + ss.str() + ")";
+}
+
+std::string integerLiteral(long long value) {
+    if (value == LLONG_MIN) return "(-9223372036854775807LL - 1)";
+    return "(" + std::to_string(value) + "LL)";
+}
+
+// C++ string literal for arbitrary text
+std::string stringLiteral(const std::string& text) {
+    std::string literal = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') literal += '\\';
+        if (c == '\n' || c == '\r') c = ' ';
+        literal += c;
+    }
+    return literal + "\"";
+}
+
+bool isIdentifier(const std::string& name) {
+    if (name.empty() || !(std::isalpha(static_cast<unsigned char>(name[0])) || name[0] == '_')) return false;
+    return std::all_of(name.begin(), name.end(), [](char c) {
+        return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+    });
+}
+
+} // namespace
+
+ExpressionCompiler::ExpressionCompiler(const std::string& namespaceName) : namespaceName(namespaceName) {}
+
+// Parse and add a formula; throws ExpressionError for invalid input
+void ExpressionCompiler::addFormula(const std::string& name, const std::string& expression) {
+    if (!isIdentifier(name)) {
+        throw ExpressionError("Error: Invalid formula name '" + name + "'");
+    }
+    for (const Formula& formula : formulas) {
+        if (formula.name == name) throw ExpressionError("Error: Duplicate formula '" + name + "'");
+    }
+
+    Formula formula;
+    formula.name = name;
+    formula.expression = expression;
+    formula.tree = evaluator.buildExpressionTree(expression);
+    collectVariables(formula.tree.getRoot(), formula);
+    formulas.push_back(formula);
+}
+
+// Add "name: expression" lines; blank lines and '#' comments are skipped
+void ExpressionCompiler::addFormulas(std::istream& input) {
+    std::string line;
+    for (size_t lineNumber = 1; std::getline(input, line); ++lineNumber) {
+        size_t start = line.find_first_not_of(" \t\r");
+        if (start == std::string::npos || line[start] == '#') continue;
+
+        size_t colon = line.find(':');
+        if (colon == std::string::npos) {
+            throw ExpressionError("Error: Line " + std::to_string(lineNumber) + ": expected 'name: expression'");
+        }
+        size_t nameEnd = line.find_last_not_of(" \t", colon - 1);
+        std::string name = (nameEnd == std::string::npos || nameEnd < start) ? "" : line.substr(start, nameEnd - start + 1);
+        try {
+            addFormula(name, line.substr(colon + 1));
+        } catch (const ExpressionError& e) {
+            throw ExpressionError("Line " + std::to_string(lineNumber) + ": " + e.what());
+        }
+    }
+}
+
+// Record the variables of a subtree in order of first appearance
+void ExpressionCompiler::collectVariables(NodePtr node, Formula& formula) {
+    if (!node) return;
+    if (node->isVariable()) {
+        if (std::find(formula.variables.begin(), formula.variables.end(), node->getName()) == formula.variables.end()) {
+            formula.variables.push_back(node->getName());
+        }
+        variableNodes.insert(node.get());
+        return;
+    }
+
+    collectVariables(node->getLeft(), formula);
+    collectVariables(node->getRight(), formula);
+    if (variableNodes.count(node->getLeft().get()) || variableNodes.count(node->getRight().get())) {
+        variableNodes.insert(node.get());
+    }
+}
+
+// Write the header declaring the lookup table
+void ExpressionCompiler::generateHeader(std::ostream& out) const {
+    out << "// Generated by PackCompiler. Do not edit.\n"
+        << "#pragma once\n\n"
+        << "#include <cstddef>\n\n"
+        << "namespace " << namespaceName << " {\n\n"
+        << "struct Formula {\n"
+        << "    const char* name;\n"
+        << "    const char* expression;\n"
+        << "    // Evaluate with variables in the order listed below. error must be 0\n"
+        << "    // on entry and receives an ExpressionError::Code; NaN is returned on error.\n"
+        << "    double (*evaluate)(const double* variables, int& error);\n"
+        << "    const char* const* variables;\n"
+        << "    size_t variableCount;\n"
+        << "};\n\n"
+        << "// All formulas, sorted by name\n"
+        << "extern const Formula formulas[];\n"
+        << "extern const size_t formulaCount;\n\n"
+        << "// Look up a formula by name; nullptr if there is none\n"
+        << "const Formula* findFormula(const char* name);\n\n"
+        << "} // namespace " << namespaceName << "\n";
+}
+
+// Write the source defining the formulas and the lookup table
+void ExpressionCompiler::generateSource(std::ostream& out, const std::string& headerName) {
+    std::vector<Formula*> sorted;
+    for (Formula& formula : formulas) {
+        sorted.push_back(&formula);
+    }
+    std::sort(sorted.begin(), sorted.end(), [](const Formula* a, const Formula* b) { return a->name < b->name; });
+
+    out << "// Generated by PackCompiler. Do not edit.\n"
+        << "#include \"" << headerName << "\"\n"
+        << "#include <cmath>\n"
+        << "#include <climits>\n"
+        << "#include <cstring>\n"
+        << "#include <algorithm>\n\n"
+        << "namespace " << namespaceName << " {\n"
+        << "namespace {\n\n"
+        << "// ExpressionError::Code values\n";
+    const std::vector<std::pair<const char*, ExpressionError::Code>> codes = {
+        {"DIVISION_BY_ZERO", ExpressionError::DIVISION_BY_ZERO},
+        {"MODULO_BY_ZERO", ExpressionError::MODULO_BY_ZERO},
+        {"SHIFT_OUT_OF_RANGE", ExpressionError::SHIFT_OUT_OF_RANGE},
+        {"BITWISE_OUT_OF_RANGE", ExpressionError::BITWISE_OUT_OF_RANGE}
+    };
+    for (const auto& code : codes) {
+        out << "const int " << code.first << " = " << static_cast<int>(code.second) << ";\n";
+    }
+    out << "\n" << PRELUDE << "\n";
+
+    for (Formula* formula : sorted) {
+        int counter = 0;
+        out << "// " << formula->name << ": " << formula->tree.inOrderTraversal() << "\n"
+            << "inline double formula_" << formula->name << "(const double* vars, int& error) {\n";
+        if (formula->variables.empty()) out << "    (void)vars;\n";
+        Emitted result = emitNode(formula->tree.getRoot(), *formula, out, counter);
+        out << "    return error ? std::nan(\"\") : "
+            << (result.isValue ? "toDouble(" + result.name + ")" : result.name) << ";\n"
+            << "}\n\n";
+
+        out << "const char* const variables_" << formula->name << "[] = {";
+        for (const std::string& variable : formula->variables) {
+            out << stringLiteral(variable) << ", ";
+        }
+        out << "nullptr};\n\n";
+    }
+
+    out << "} // namespace\n\n"
+        << "const Formula formulas[] = {\n";
+    for (Formula* formula : sorted) {
+        out << "    {" << stringLiteral(formula->name) << ", " << stringLiteral(formula->expression)
+            << ", formula_" << formula->name << ", variables_" << formula->name
+            << ", " << formula->variables.size() << "},\n";
+    }
+    out << "};\n"
+        << "const size_t formulaCount = " << sorted.size() << ";\n\n"
+        << "const Formula* findFormula(const char* name) {\n"
+        << "    const Formula* end = formulas + formulaCount;\n"
+        << "    const Formula* it = std::lower_bound(formulas, end, name, [](const Formula& formula, const char* key) {\n"
+        << "        return std::strcmp(formula.name, key) < 0;\n"
+        << "    });\n"
+        << "    return (it != end && std::strcmp(it->name, name) == 0) ? it : nullptr;\n"
+        << "}\n\n"
+        << "} // namespace " << namespaceName << "\n";
+}
+
+// Emit statements computing node into locals, children first (left, then
+// right) so errors are raised in the same order as the interpreter
+ExpressionCompiler::Emitted ExpressionCompiler::emitNode(NodePtr node, const Formula& formula,
+                                                         std::ostream& out, int& counter) {
+    if (!node) {
+        throw ExpressionError(ExpressionError::NULL_NODE);
+    }
+    if (!variableNodes.count(node.get())) {
+        return emitConstant(node, out, counter);
+    }
+
+    if (node->isVariable()) {
+        std::string name = "t" + std::to_string(counter++);
+        size_t index = std::find(formula.variables.begin(), formula.variables.end(), node->getName()) -
+                       formula.variables.begin();
+        out << "    const double " << name << " = vars[" << index << "];\n";
+        return Emitted{name, false};
+    }
+
+    const std::string& op = node->getOperator();
+    const OperatorRegistry& operators = evaluator.getOperators();
+    const OperatorDescriptor* descriptor = node->isUnaryOp() ? operators.findUnary(op) : operators.find(op);
+    std::string name;
+    auto asDouble = [](const Emitted& e) { return e.isValue ? "toDouble(" + e.name + ")" : e.name; };
+    auto asValue = [](const Emitted& e) { return e.isValue ? e.name : "real(" + e.name + ")"; };
+
+    if (node->isUnaryOp()) {
+        Emitted operand = emitNode(node->getRight(), formula, out, counter);
+        name = "t" + std::to_string(counter++);
+        if (!node->isInteger()) {
+            if (!descriptor || descriptor->id != OperatorDescriptor::NEGATE) {
+                throw ExpressionError(ExpressionError::UNKNOWN_OPERATOR);
+            }
+            out << "    const double " << name << " = -" << asDouble(operand) << ";\n";
+            return Emitted{name, false};
+        }
+        const char* function = valueFunction(descriptor);
+        if (!function) throw ExpressionError(ExpressionError::UNKNOWN_OPERATOR);
+        out << "    const Value " << name << " = " << function << "(" << asValue(operand) << ", error);\n";
+        return Emitted{name, true};
+    }
+
+    Emitted left = emitNode(node->getLeft(), formula, out, counter);
+    Emitted right = emitNode(node->getRight(), formula, out, counter);
+    name = "t" + std::to_string(counter++);
+
+    if (!node->isInteger()) {
+        std::string a = asDouble(left), b = asDouble(right);
+        std::string expression;
+        switch (descriptor ? descriptor->id : -1) {
+        case OperatorDescriptor::ADD:
+        case OperatorDescriptor::SUBTRACT:
+        case OperatorDescriptor::MULTIPLY:
+            expression = a + " " + op + " " + b;
+            break;
+        case OperatorDescriptor::DIVIDE:
+            expression = "divide(" + a + ", " + b + ", error)";
+            break;
+        case OperatorDescriptor::MODULO:
+            expression = "modulo(" + a + ", " + b + ", error)";
+            break;
+        case OperatorDescriptor::POWER:
+            expression = "std::pow(" + a + ", " + b + ")";
+            break;
+        default:
+            // Registered operators have no C++ source to emit
+            throw ExpressionError(ExpressionError::UNKNOWN_OPERATOR);
+        }
+        out << "    const double " << name << " = " << expression << ";\n";
+        return Emitted{name, false};
+    }
+
+    const char* function = valueFunction(descriptor);
+    if (!function) throw ExpressionError(ExpressionError::UNKNOWN_OPERATOR);
+    out << "    const Value " << name << " = " << function << "(" << asValue(left) << ", "
+        << asValue(right) << ", error);\n";
+    return Emitted{name, true};
+}
+
+// Emit a variable-free subtree as its folded value (or its error)
+ExpressionCompiler::Emitted ExpressionCompiler::emitConstant(NodePtr node, std::ostream& out, int& counter) {
+    std::string name = "t" + std::to_string(counter++);
+    ExpressionEvaluator::Value value;
+    ExpressionError::Code error = evaluator.tryEvaluate(ExpressionTree(node), value);
+
+    if (node->isInteger()) {
+        out << "    const Value " << name << " = ";
+        if (error != ExpressionError::NONE) out << "failValue(error, " << static_cast<int>(error) << ")";
+        else if (value.isInteger) out << "integer(" << integerLiteral(value.integer) << ")";
+        else out << "real(" << doubleLiteral(value.real) << ")";
+        out << ";\n";
+        return Emitted{name, true};
+    }
+
+    out << "    const double " << name << " = ";
+    if (error != ExpressionError::NONE) out << "fail(error, " << static_cast<int>(error) << ")";
+    else out << doubleLiteral(value.toDouble());
+    out << ";\n";
+    return Emitted{name, false};
+}
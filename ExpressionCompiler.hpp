@@ -0,0 +1,70 @@
+#ifndef EXPRESSION_COMPILER_HPP
+#define EXPRESSION_COMPILER_HPP
+
+#include "ExpressionEvaluator.hpp"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <unordered_set>
+
+/**
+ * Ahead-of-time compiler for a catalogue of formulas
+ *
+ * Each formula is parsed with ExpressionEvaluator::buildExpressionTree and
+ * emitted as an inline C++ function with the evaluator's semantics (int64
+ * kernels for integer subtrees, error codes instead of exceptions), plus a
+ * sorted name -> function table. Variable-free subtrees are folded at
+ * generation time.
+ *
+ * Generated signature: double f(const double* variables, int& error)
+ * where variables are in order of first appearance in the formula and error
+ * receives an ExpressionError::Code (NaN is returned on error).
+ */
+class ExpressionCompiler {
+public:
+    explicit ExpressionCompiler(const std::string& namespaceName = "expression_pack");
+
+    // Parse and add a formula; throws ExpressionError for invalid input
+    void addFormula(const std::string& name, const std::string& expression);
+
+    // Add "name: expression" lines; blank lines and '#' comments are skipped
+    void addFormulas(std::istream& input);
+
+    // Write the header declaring the lookup table
+    void generateHeader(std::ostream& out) const;
+
+    // Write the source defining the formulas and the lookup table
+    void generateSource(std::ostream& out, const std::string& headerName);
+
+private:
+    struct Formula {
+        std::string name;
+        std::string expression;
+        ExpressionTree tree;
+        std::vector<std::string> variables;
+    };
+
+    // Result of emitting a node: the local holding it and whether that local
+    // is a typed Value (INTEGER nodes) or a plain double (FLOAT nodes)
+    struct Emitted {
+        std::string name;
+        bool isValue;
+    };
+
+    // Record the variables of a subtree in order of first appearance, and
+    // mark every node that depends on a variable
+    void collectVariables(NodePtr node, Formula& formula);
+
+    // Emit statements computing node into locals, in evaluation order
+    Emitted emitNode(NodePtr node, const Formula& formula, std::ostream& out, int& counter);
+
+    // Emit a variable-free subtree as its folded value (or its error)
+    Emitted emitConstant(NodePtr node, std::ostream& out, int& counter);
+
+    std::string namespaceName;
+    ExpressionEvaluator evaluator;
+    std::vector<Formula> formulas;
+    std::unordered_set<const Node*> variableNodes;
+};
+
+#endif // EXPRESSION_COMPILER_HPP
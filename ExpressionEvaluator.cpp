@@ -1,95 +1,636 @@
 #include "ExpressionEvaluator.hpp"
+#include "ExpressionProfile.hpp"
 #include <iostream>
 #include <sstream>
+#include <iomanip>
 #include <stack>
 #include <algorithm>
 #include <cctype>
 #include <cmath>
-#include <regex>
-
-ExpressionEvaluator::ExpressionEvaluator() {
-    // Initialize binary operators
-    binaryOps["+"] = [](double a, double b) { return a + b; };
-    binaryOps["-"] = [](double a, double b) { return a - b; };
-    binaryOps["*"] = [](double a, double b) { return a * b; };
-    binaryOps["/"] = [](double a, double b) {
-        if (b == 0) throw ExpressionError("Error: Division by zero");
-        return a / b;
-    };
-    binaryOps["%"] = [](double a, double b) {
-        if (b == 0) throw ExpressionError("Error: Modulo by zero");
-        return std::fmod(a, b);
+#include <climits>
+#include <cerrno>
+#include <cstdlib>
+#include <string_view>
+#include <thread>
+#include <exception>
+#include <atomic>
+
+namespace {
+
+// Probe of unprofiled evaluation: every hook is empty and compiles away
+struct NoProbe {
+    struct Scope {
+        Scope(NoProbe&, const Node*, const ExpressionError::Code&) {}
     };
-    // Add power operator
-    binaryOps["^"] = [](double a, double b) { return std::pow(a, b); };
-    
-    binaryOps["=="] = [](double a, double b) { return a == b ? 1.0 : 0.0; };
-    binaryOps["!="] = [](double a, double b) { return a != b ? 1.0 : 0.0; };
-    binaryOps["<"] = [](double a, double b) { return a < b ? 1.0 : 0.0; };
-    binaryOps[">"] = [](double a, double b) { return a > b ? 1.0 : 0.0; };
-    binaryOps["<="] = [](double a, double b) { return a <= b ? 1.0 : 0.0; };
-    binaryOps[">="] = [](double a, double b) { return a >= b ? 1.0 : 0.0; };
-    binaryOps["&&"] = [](double a, double b) { return (a != 0 && b != 0) ? 1.0 : 0.0; };
-    binaryOps["||"] = [](double a, double b) { return (a != 0 || b != 0) ? 1.0 : 0.0; };
-    binaryOps["&"] = [](double a, double b) { return static_cast<double>(static_cast<int>(a) & static_cast<int>(b)); };
-    binaryOps["|"] = [](double a, double b) { return static_cast<double>(static_cast<int>(a) | static_cast<int>(b)); };
-    // Use "xor" for bitwise XOR to avoid conflict with power operator
-    binaryOps["xor"] = [](double a, double b) { return static_cast<double>(static_cast<int>(a) ^ static_cast<int>(b)); };
-    binaryOps["<<"] = [](double a, double b) { return static_cast<double>(static_cast<int>(a) << static_cast<int>(b)); };
-    binaryOps[">>"] = [](double a, double b) { return static_cast<double>(static_cast<int>(a) >> static_cast<int>(b)); };
-    
-    // Keyword operators
-    binaryOps["and"] = [](double a, double b) { return (a != 0 && b != 0) ? 1.0 : 0.0; };
-    binaryOps["or"] = [](double a, double b) { return (a != 0 || b != 0) ? 1.0 : 0.0; };
-    
-    // Initialize unary operators
-    unaryOps["-"] = [](double a) { return -a; };
-    unaryOps["~"] = [](double a) { return static_cast<double>(~static_cast<int>(a)); };
-    unaryOps["not"] = [](double a) { return (a == 0) ? 1.0 : 0.0; };
+    void shortCircuit(const OperatorDescriptor&, double, const Node&) {}
+};
+
+// Run body(i) for i in [0, count) on up to threadCount threads, each thread
+// taking a contiguous block of indices. The first exception thrown is rethrown.
+template <typename Body>
+void parallelFor(size_t count, size_t threadCount, Body body) {
+    threadCount = std::max<size_t>(1, std::min(threadCount, count));
+    std::vector<std::thread> workers;
+    std::vector<std::exception_ptr> errors(threadCount);
+    
+    for (size_t t = 0; t < threadCount; ++t) {
+        workers.emplace_back([&, t]() {
+            try {
+                for (size_t i = count * t / threadCount; i < count * (t + 1) / threadCount; ++i) {
+                    body(i);
+                }
+            } catch (...) {
+                errors[t] = std::current_exception();
+            }
+        });
+    }
+    
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    for (const auto& error : errors) {
+        if (error) std::rethrow_exception(error);
+    }
+}
+
+// A chunk may start at position pos when the previous character always ends a
+// token and the current character does not depend on the preceding token
+// (signs are unary or binary depending on what came before them).
+bool isChunkBoundary(const std::string& expr, size_t pos) {
+    char prev = expr[pos - 1];
+    char c = expr[pos];
+    bool prevEndsToken = std::isspace(static_cast<unsigned char>(prev)) ||
+                         prev == '(' || prev == ')' || prev == '*' || prev == '/' ||
+                         prev == '%' || prev == '^' || prev == '+' || prev == '-' || prev == '~';
+    bool contextFree = !std::isspace(static_cast<unsigned char>(c)) &&
+                       c != '+' && c != '-' && c != '~' && c != '!';
+    return prevEndsToken && contextFree;
+}
+
+// Bitwise operand of a typed value, setting error if it is out of range
+long long integerOperand(const ExpressionEvaluator::Value& value, ExpressionError::Code& error) {
+    long long result = value.integer;
+    if (!value.isInteger && !OperatorRegistry::toInteger(value.real, result)) {
+        error = ExpressionError::BITWISE_OUT_OF_RANGE;
+    }
+    return result;
+}
+
+// Static result type of an operator node: arithmetic stays integer when both
+// operands are integers, division and custom operators always yield doubles,
+// comparison, logical and bitwise operators always yield integers. Unary
+// operators pass their operand type for both sides.
+bool yieldsInteger(const OperatorDescriptor& op, bool leftInteger, bool rightInteger) {
+    switch (op.category) {
+    case OperatorDescriptor::ARITHMETIC:
+        return leftInteger && rightInteger;
+    case OperatorDescriptor::DIVISION:
+    case OperatorDescriptor::CUSTOM:
+        return false;
+    default:
+        return true;
+    }
+}
+
+// Operators whose chains rebalance may regroup. && and || combine truth
+// values exactly and never fail themselves, so regrouping changes neither the
+// result nor the first error. Regrouped + and * round (or overflow int64)
+// differently, and & | xor may check an out-of-range operand only after a
+// later operand has failed, so those need strictFloatingPoint off.
+bool isReassociable(const OperatorDescriptor& op, bool strictFloatingPoint) {
+    switch (op.id) {
+    case OperatorDescriptor::LOGICAL_AND:
+    case OperatorDescriptor::LOGICAL_OR:
+        return true;
+    case OperatorDescriptor::ADD:
+    case OperatorDescriptor::MULTIPLY:
+    case OperatorDescriptor::BIT_AND:
+    case OperatorDescriptor::BIT_OR:
+    case OperatorDescriptor::BIT_XOR:
+        return !strictFloatingPoint;
+    default:
+        return false;
+    }
+}
+
+// Number of nodes in the subtree of node, counting no further than limit
+size_t countNodes(const Node* node, size_t limit) {
+    size_t count = 0;
+    std::vector<const Node*> pending;
+    if (node) pending.push_back(node);
+    while (!pending.empty() && count < limit) {
+        const Node* current = pending.back();
+        pending.pop_back();
+        ++count;
+        if (current->getLeft()) pending.push_back(current->getLeft().get());
+        if (current->getRight()) pending.push_back(current->getRight().get());
+    }
+    return count;
+}
+
+} // namespace
+
+ExpressionEvaluator::ExpressionEvaluator() : registry(true) {
+    // The operator table starts out with the built-in operators
 }
 
 // Parse an expression and build the expression tree
-ExpressionTree ExpressionEvaluator::buildExpressionTree(const std::string& expression) {
-    std::vector<std::string> tokens = tokenize(expression);
-    std::vector<std::string> postfix = infixToPostfix(tokens);
-    NodePtr root = buildTreeFromPostfix(postfix);
-    return ExpressionTree(root);
+ExpressionTree ExpressionEvaluator::buildExpressionTree(const std::string& expression) const {
+    ExpressionTree tree;
+    ExpressionError::Code error = tryBuildExpressionTree(expression, tree);
+    if (error != ExpressionError::NONE) {
+        throw ExpressionError(error);
+    }
+    return tree;
 }
 
 // Evaluate the expression tree and return the result
-double ExpressionEvaluator::evaluate(const ExpressionTree& tree) {
-    return evaluateNode(tree.getRoot());
+double ExpressionEvaluator::evaluate(const ExpressionTree& tree) const {
+    return evaluateValue(tree).toDouble();
 }
 
 // Direct evaluation from expression string
-double ExpressionEvaluator::evaluate(const std::string& expression) {
-    ExpressionTree tree = buildExpressionTree(expression);
-    return evaluate(tree);
+double ExpressionEvaluator::evaluate(const std::string& expression) const {
+    Value result;
+    ExpressionError::Code error = tryEvaluate(expression, result);
+    if (error != ExpressionError::NONE) {
+        throw ExpressionError(error);
+    }
+    return result.toDouble();
 }
 
-// Tokenize the input expression
-std::vector<std::string> ExpressionEvaluator::tokenize(const std::string& expression) {
-    std::vector<std::string> tokens;
-    std::string expr = expression;
+// Evaluate the expression tree, keeping integer results exact
+ExpressionEvaluator::Value ExpressionEvaluator::evaluateValue(const ExpressionTree& tree) const {
+    Value result;
+    ExpressionError::Code error = tryEvaluate(tree, result);
+    if (error != ExpressionError::NONE) {
+        throw ExpressionError(error);
+    }
+    return result;
+}
+
+// Bind a value to a variable used by subsequent evaluations
+void ExpressionEvaluator::setVariable(const std::string& name, double value) {
+    variables[name] = value;
+}
+
+void ExpressionEvaluator::clearVariables() {
+    variables.clear();
+}
+
+// Register a custom binary operator
+void ExpressionEvaluator::registerOperator(const std::string& symbol, int precedence, bool rightAssociative,
+                                           OperatorDescriptor::BinaryKernel kernel) {
+    registry.addBinary(symbol, precedence, rightAssociative, kernel);
+}
+
+// Register a custom prefix operator
+void ExpressionEvaluator::registerOperator(const std::string& symbol, OperatorDescriptor::UnaryKernel kernel) {
+    registry.addUnary(symbol, kernel);
+}
+
+// Parse an expression without throwing; tree is left unchanged on error
+ExpressionError::Code ExpressionEvaluator::tryBuildExpressionTree(const std::string& expression,
+                                                                  ExpressionTree& tree) const {
+    std::vector<std::string> tokens = tokenize(expression);
+    std::vector<std::string> postfix;
+    NodePtr root;
     
-    // Replace keywords with operators for easier processing
-    std::map<std::string, std::string> keywords = {
-        {"and", "&&"},
-        {"or", "||"}
-        // Keep "not" as is since it's a unary operator
+    ExpressionError::Code error = infixToPostfix(tokens, postfix);
+    if (error == ExpressionError::NONE) {
+        error = buildTreeFromPostfix(postfix, root);
+    }
+    if (error == ExpressionError::NONE) {
+        tree.setRoot(root);
+    }
+    return error;
+}
+
+// Evaluate an expression tree without throwing
+ExpressionError::Code ExpressionEvaluator::tryEvaluate(const ExpressionTree& tree, Value& result) const {
+    ExpressionError::Code error = ExpressionError::NONE;
+    NodePtr root = tree.getRoot();
+    
+    NoProbe probe;
+    
+    if (root && root->isInteger()) {
+        result = evaluateIntegerNode(root, error, probe);
+    } else {
+        result = Value{false, 0, evaluateNode(root, error, probe)};
+    }
+    return error;
+}
+
+// Evaluate the profiled tree, recording every node in the profile
+ExpressionError::Code ExpressionEvaluator::tryEvaluate(ExpressionProfile& profile, Value& result) const {
+    ExpressionError::Code error = ExpressionError::NONE;
+    NodePtr root = profile.tree.getRoot();
+    profile.begin();
+    
+    if (root && root->isInteger()) {
+        result = evaluateIntegerNode(root, error, profile);
+    } else {
+        result = Value{false, 0, evaluateNode(root, error, profile)};
+    }
+    return error;
+}
+
+// Parse and evaluate an expression without throwing. Typical inputs are
+// evaluated during parsing without allocating; others use the tree path.
+ExpressionError::Code ExpressionEvaluator::tryEvaluate(const std::string& expression, Value& result) const {
+    ExpressionError::Code error = ExpressionError::NONE;
+    if (evaluateDirect(expression, result, error)) {
+        return error;
+    }
+    
+    ExpressionTree tree;
+    error = tryBuildExpressionTree(expression, tree);
+    if (error != ExpressionError::NONE) {
+        return error;
+    }
+    return tryEvaluate(tree, result);
+}
+
+// Evaluate every tree; failures become NaN rows with an error code and bit
+ExpressionEvaluator::BatchResult ExpressionEvaluator::evaluateBatch(const std::vector<ExpressionTree>& trees) const {
+    BatchResult batch;
+    batch.values.resize(trees.size());
+    batch.errors.resize(trees.size(), ExpressionError::NONE);
+    batch.errorBitmap.resize((trees.size() + 63) / 64, 0);
+    
+    Value value;
+    for (size_t row = 0; row < trees.size(); ++row) {
+        ExpressionError::Code error = tryEvaluate(trees[row], value);
+        batch.values[row] = value.toDouble();
+        if (error != ExpressionError::NONE) {
+            batch.values[row] = std::nan("");
+            batch.errors[row] = error;
+            batch.errorBitmap[row / 64] |= uint64_t(1) << (row % 64);
+            ++batch.errorCount;
+        }
+    }
+    return batch;
+}
+
+// Parse and evaluate every expression; a row that fails to parse is not
+// evaluated and reports its parse error
+ExpressionEvaluator::BatchResult ExpressionEvaluator::evaluateBatch(const std::vector<std::string>& expressions) const {
+    BatchResult batch;
+    batch.values.resize(expressions.size());
+    batch.errors.resize(expressions.size(), ExpressionError::NONE);
+    batch.errorBitmap.resize((expressions.size() + 63) / 64, 0);
+    
+    Value value;
+    for (size_t row = 0; row < expressions.size(); ++row) {
+        ExpressionTree tree;
+        ExpressionError::Code error = tryBuildExpressionTree(expressions[row], tree);
+        if (error == ExpressionError::NONE) {
+            error = tryEvaluate(tree, value);
+            batch.values[row] = value.toDouble();
+        }
+        if (error != ExpressionError::NONE) {
+            batch.values[row] = std::nan("");
+            batch.errors[row] = error;
+            batch.errorBitmap[row / 64] |= uint64_t(1) << (row % 64);
+            ++batch.errorCount;
+        }
+    }
+    return batch;
+}
+
+// Format a result for display: integers without decimals, otherwise 6 decimals
+std::string ExpressionEvaluator::formatResult(double result) {
+    std::ostringstream ss;
+    
+    // Check if result is effectively an integer that fits in a long long
+    if (std::abs(result - std::round(result)) < 1e-10 && std::abs(result) < 9.2e18) {
+        ss << static_cast<long long>(result);
+    } else {
+        ss << std::fixed << std::setprecision(6) << result;
+    }
+    return ss.str();
+}
+
+// Format a typed result: integers are printed exactly
+std::string ExpressionEvaluator::formatResult(const Value& result) {
+    return result.isInteger ? std::to_string(result.integer) : formatResult(result.real);
+}
+
+// Parse a very large expression using several threads:
+//   1. split the input into chunks at token boundaries and lex them concurrently
+//   2. compute the parenthesis depth at the start of each chunk (prefix sum)
+//   3. find the lowest-precedence binary operators at depth 0 and split there
+//   4. build the subtree of each top-level operand on separate threads
+//   5. join the subtrees under the split operators, left- or right-associatively
+// The resulting tree has the same shape as the one from buildExpressionTree.
+// Malformed input is parsed again serially, so the error reported is the one
+// tryBuildExpressionTree reports rather than that of whichever part failed.
+ExpressionError::Code ExpressionEvaluator::tryBuildExpressionTreeParallel(const std::string& expression,
+                                                                          ExpressionTree& tree,
+                                                                          size_t threadCount) const {
+    if (threadCount == 0) {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+    // Chunk boundaries assume the built-in operator spellings
+    if (threadCount == 1 || expression.length() < PARALLEL_PARSE_THRESHOLD || registry.hasUserOperators()) {
+        return tryBuildExpressionTree(expression, tree);
+    }
+    
+    // Choose chunk start positions, moving each nominal split point forward to
+    // the next position where lexing can start without any context
+    std::vector<size_t> bounds = {0};
+    for (size_t t = 1; t < threadCount; ++t) {
+        size_t pos = std::max(bounds.back() + 1, expression.length() * t / threadCount);
+        while (pos < expression.length() && !isChunkBoundary(expression, pos)) {
+            ++pos;
+        }
+        if (pos >= expression.length()) break;
+        bounds.push_back(pos);
+    }
+    bounds.push_back(expression.length());
+    size_t chunkCount = bounds.size() - 1;
+    
+    // Lex the chunks concurrently and count their net parenthesis depth
+    std::vector<std::vector<std::string>> chunkTokens(chunkCount);
+    std::vector<long> chunkDepth(chunkCount, 0);
+    parallelFor(chunkCount, threadCount, [&](size_t c) {
+        tokenizeRange(expression, bounds[c], bounds[c + 1], chunkTokens[c]);
+        for (const std::string& token : chunkTokens[c]) {
+            if (token == "(") ++chunkDepth[c];
+            else if (token == ")") --chunkDepth[c];
+        }
+    });
+    
+    // Exclusive prefix sum of depths and token counts gives each chunk its
+    // starting depth and its offset in the flattened token stream
+    std::vector<long> startDepth(chunkCount, 0);
+    std::vector<size_t> tokenOffset(chunkCount + 1, 0);
+    for (size_t c = 0; c < chunkCount; ++c) {
+        if (c > 0) startDepth[c] = startDepth[c - 1] + chunkDepth[c - 1];
+        tokenOffset[c + 1] = tokenOffset[c] + chunkTokens[c].size();
+    }
+    
+    // Find the lowest precedence among top-level binary operators in each chunk
+    const int NO_SPLIT = 100;
+    std::vector<int> chunkMinPrecedence(chunkCount, NO_SPLIT);
+    parallelFor(chunkCount, threadCount, [&](size_t c) {
+        long depth = startDepth[c];
+        for (const std::string& token : chunkTokens[c]) {
+            if (token == "(") ++depth;
+            else if (token == ")") --depth;
+            else if (depth == 0 && isOperator(token) && !isUnaryOperator(token)) {
+                chunkMinPrecedence[c] = std::min(chunkMinPrecedence[c], getPrecedence(token));
+            }
+        }
+    });
+    int splitPrecedence = *std::min_element(chunkMinPrecedence.begin(), chunkMinPrecedence.end());
+    
+    // Flatten the token stream and collect the split positions of each chunk
+    std::vector<std::string> tokens(tokenOffset[chunkCount]);
+    std::vector<std::vector<size_t>> chunkSplits(chunkCount);
+    parallelFor(chunkCount, threadCount, [&](size_t c) {
+        long depth = startDepth[c];
+        for (size_t i = 0; i < chunkTokens[c].size(); ++i) {
+            std::string& token = chunkTokens[c][i];
+            if (token == "(") ++depth;
+            else if (token == ")") --depth;
+            else if (depth == 0 && isOperator(token) && !isUnaryOperator(token) &&
+                     getPrecedence(token) == splitPrecedence) {
+                chunkSplits[c].push_back(tokenOffset[c] + i);
+            }
+            tokens[tokenOffset[c] + i] = std::move(token);
+        }
+    });
+    
+    std::vector<size_t> splits;
+    for (const auto& chunk : chunkSplits) {
+        splits.insert(splits.end(), chunk.begin(), chunk.end());
+    }
+    
+    // No top-level operator to split on: parse the token stream serially
+    if (splits.empty()) {
+        std::vector<std::string> postfix;
+        NodePtr root;
+        ExpressionError::Code error = infixToPostfix(tokens, postfix);
+        if (error == ExpressionError::NONE) error = buildTreeFromPostfix(postfix, root);
+        if (error != ExpressionError::NONE) return tryBuildExpressionTree(expression, tree);
+        tree.setRoot(root);
+        return ExpressionError::NONE;
+    }
+    
+    // Build every top-level operand subtree independently
+    std::vector<NodePtr> subtrees(splits.size() + 1);
+    std::vector<ExpressionError::Code> errors(subtrees.size(), ExpressionError::NONE);
+    parallelFor(subtrees.size(), threadCount, [&](size_t s) {
+        size_t first = (s == 0) ? 0 : splits[s - 1] + 1;
+        size_t last = (s == splits.size()) ? tokens.size() : splits[s];
+        if (first == last) {
+            errors[s] = ExpressionError::INVALID_BINARY_SYNTAX;
+            return;
+        }
+        std::vector<std::string> segment(tokens.begin() + first, tokens.begin() + last);
+        std::vector<std::string> postfix;
+        errors[s] = infixToPostfix(segment, postfix);
+        if (errors[s] == ExpressionError::NONE) errors[s] = buildTreeFromPostfix(postfix, subtrees[s]);
+    });
+    for (ExpressionError::Code error : errors) {
+        if (error != ExpressionError::NONE) return tryBuildExpressionTree(expression, tree);
+    }
+    
+    // Join the subtrees under the split operators (all share one precedence level)
+    NodePtr root;
+    if (isRightAssociative(tokens[splits.front()])) {
+        root = subtrees.back();
+        for (size_t s = splits.size(); s-- > 0;) {
+            root = makeBinaryNode(*registry.find(tokens[splits[s]]), subtrees[s], root);
+        }
+    } else {
+        root = subtrees.front();
+        for (size_t s = 0; s < splits.size(); ++s) {
+            root = makeBinaryNode(*registry.find(tokens[splits[s]]), root, subtrees[s + 1]);
+        }
+    }
+    tree.setRoot(root);
+    return ExpressionError::NONE;
+}
+
+// Parse a very large expression using several threads, throwing on failure
+ExpressionTree ExpressionEvaluator::buildExpressionTreeParallel(const std::string& expression,
+                                                                size_t threadCount) const {
+    ExpressionTree tree;
+    ExpressionError::Code error = tryBuildExpressionTreeParallel(expression, tree, threadCount);
+    if (error != ExpressionError::NONE) {
+        throw ExpressionError(error);
+    }
+    return tree;
+}
+
+// Rebalance the associative chains of a tree
+ExpressionTree ExpressionEvaluator::rebalance(const ExpressionTree& tree, bool strictFloatingPoint) const {
+    return ExpressionTree(rebalanceNode(tree.getRoot(), strictFloatingPoint));
+}
+
+// Rebalance the subtree of node. A chain is a maximal group of binary nodes
+// of one reassociable operator; it is flattened with an explicit stack (a
+// parsed chain is as deep as it is long) and its operands are joined in
+// halves. Other nodes are copied only if a child changed.
+NodePtr ExpressionEvaluator::rebalanceNode(const NodePtr& node, bool strictFloatingPoint) const {
+    if (!node || node->isOperand() || node->isVariable()) {
+        return node;
+    }
+    
+    if (node->isUnaryOp()) {
+        NodePtr right = rebalanceNode(node->getRight(), strictFloatingPoint);
+        if (right == node->getRight()) return node;
+        NodePtr copy = std::make_shared<Node>(node->getOperator(), right);
+        copy->setValueType(node->getValueType());
+        return copy;
+    }
+    
+    const OperatorDescriptor* op = registry.find(node->getOperator());
+    if (!op || !isReassociable(*op, strictFloatingPoint) || !node->getLeft() || !node->getRight()) {
+        NodePtr left = rebalanceNode(node->getLeft(), strictFloatingPoint);
+        NodePtr right = rebalanceNode(node->getRight(), strictFloatingPoint);
+        if (left == node->getLeft() && right == node->getRight()) return node;
+        NodePtr copy = std::make_shared<Node>(node->getOperator(), left, right);
+        copy->setValueType(node->getValueType());
+        return copy;
+    }
+    
+    // Collect the chain's operands from left to right ("and" and "&&" are one operator)
+    auto inChain = [this, op](const NodePtr& candidate) {
+        if (!candidate->isOperator() || !candidate->getLeft() || !candidate->getRight()) return false;
+        const OperatorDescriptor* candidateOp = registry.find(candidate->getOperator());
+        return candidateOp && candidateOp->id == op->id;
     };
+    std::vector<NodePtr> operands;
+    std::vector<NodePtr> pending = {node};
+    while (!pending.empty()) {
+        NodePtr current = std::move(pending.back());
+        pending.pop_back();
+        if (inChain(current)) {
+            pending.push_back(current->getRight());
+            pending.push_back(current->getLeft());
+        } else {
+            operands.push_back(rebalanceNode(current, strictFloatingPoint));
+        }
+    }
+    if (operands.size() == 2 && operands[0] == node->getLeft() && operands[1] == node->getRight()) {
+        return node;
+    }
     
-    // List of multicharacter operators
-    std::vector<std::string> multiCharOps = {"==", "!=", "<=", ">=", "&&", "||", "<<", ">>"};
+    // Join the halves; types are inferred again, as the parser does
+    auto join = [this, op, &operands](auto& self, size_t begin, size_t end) -> NodePtr {
+        if (end - begin == 1) return operands[begin];
+        size_t middle = begin + (end - begin + 1) / 2;
+        return makeBinaryNode(*op, self(self, begin, middle), self(self, middle, end));
+    };
+    return join(join, 0, operands.size());
+}
+
+// Evaluate a tree on several threads:
+//   1. split operator nodes into their operands, level by level, until there
+//      are a few subtrees per thread (a balanced tree splits evenly; subtree
+//      sizes are not counted, which would cost as much as evaluating them)
+//   2. evaluate the subtrees concurrently, each thread taking the next one
+//   3. evaluate the operators above them from their results
+ExpressionError::Code ExpressionEvaluator::tryEvaluateParallel(const ExpressionTree& tree, Value& result,
+                                                               size_t threadCount) const {
+    if (threadCount == 0) {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+    NodePtr root = tree.getRoot();
+    if (threadCount == 1 || countNodes(root.get(), PARALLEL_EVALUATE_THRESHOLD) < PARALLEL_EVALUATE_THRESHOLD) {
+        return tryEvaluate(tree, result);
+    }
     
-    // Replace keywords with their operator equivalents
-    for (const auto& keyword : keywords) {
-        std::regex pattern("\\b" + keyword.first + "\\b");
-        expr = std::regex_replace(expr, pattern, keyword.second);
+    std::vector<NodePtr> subtrees = {root};
+    for (bool split = true; split && subtrees.size() < 4 * threadCount;) {
+        split = false;
+        std::vector<NodePtr> next;
+        for (const NodePtr& subtree : subtrees) {
+            if (subtree->isOperand() || subtree->isVariable()) {
+                next.push_back(subtree);
+                continue;
+            }
+            split = true;
+            if (subtree->getLeft()) next.push_back(subtree->getLeft());
+            if (subtree->getRight()) next.push_back(subtree->getRight());
+        }
+        subtrees.swap(next);
+    }
+    
+    std::vector<SubtreeResult> results(subtrees.size());
+    std::atomic<size_t> nextSubtree{0};
+    parallelFor(threadCount, threadCount, [&](size_t) {
+        for (size_t s = nextSubtree++; s < subtrees.size(); s = nextSubtree++) {
+            results[s].error = tryEvaluate(ExpressionTree(subtrees[s]), results[s].value);
+        }
+    });
+    
+    std::unordered_map<const Node*, SubtreeResult> done;
+    for (size_t s = 0; s < subtrees.size(); ++s) {
+        done.emplace(subtrees[s].get(), results[s]);
+    }
+    ExpressionError::Code error = ExpressionError::NONE;
+    result = evaluateAbove(root, done, error);
+    return error;
+}
+
+// Evaluate the operators above the evaluated subtrees. Operands are taken
+// left to right and the operator is looked up first, as in evaluateNode, so
+// the error reported is the one sequential evaluation would report.
+ExpressionEvaluator::Value ExpressionEvaluator::evaluateAbove(
+    const NodePtr& node, const std::unordered_map<const Node*, SubtreeResult>& done,
+    ExpressionError::Code& error) const {
+    const Value failed{false, 0, std::nan("")};
+    if (!node) {
+        error = ExpressionError::NULL_NODE;
+        return failed;
+    }
+    auto it = done.find(node.get());
+    if (it != done.end()) {
+        error = it->second.error;
+        return (error == ExpressionError::NONE) ? it->second.value : failed;
     }
     
+    const OperatorDescriptor* op = node->isUnaryOp() ? registry.findUnary(node->getOperator())
+                                                     : registry.find(node->getOperator());
+    if (!op) {
+        error = ExpressionError::UNKNOWN_OPERATOR;
+        return failed;
+    }
+    
+    if (node->isUnaryOp()) {
+        Value operand = evaluateAbove(node->getRight(), done, error);
+        if (error != ExpressionError::NONE) return failed;
+        return node->isInteger() ? applyIntegerUnary(*op, operand, error)
+                                 : Value{false, 0, applyUnary(*op, operand.toDouble(), error)};
+    }
+    
+    Value left = evaluateAbove(node->getLeft(), done, error);
+    if (error != ExpressionError::NONE) return failed;
+    Value right = evaluateAbove(node->getRight(), done, error);
+    if (error != ExpressionError::NONE) return failed;
+    return node->isInteger() ? applyIntegerBinary(*op, left, right, error)
+                             : Value{false, 0, applyBinary(*op, left.toDouble(), right.toDouble(), error)};
+}
+
+// Tokenize the input expression
+std::vector<std::string> ExpressionEvaluator::tokenize(const std::string& expression) const {
+    std::vector<std::string> tokens;
+    tokenizeRange(expression, 0, expression.length(), tokens);
+    return tokens;
+}
+
+// Tokenize expression[begin, end) and append the tokens.
+// Operators are recognised through the registry (longest symbol first) and
+// keyword aliases are mapped to their symbols while scanning identifiers,
+// which keeps the lexer a single linear pass that can run on independent chunks.
+void ExpressionEvaluator::tokenizeRange(const std::string& expr, size_t begin, size_t end,
+                                        std::vector<std::string>& tokens) const {
     std::string token;
-    for (size_t i = 0; i < expr.length(); ++i) {
+    for (size_t i = begin; i < end; ++i) {
         char c = expr[i];
         
         // Skip whitespace
@@ -100,7 +641,7 @@ std::vector<std::string> ExpressionEvaluator::tokenize(const std::string& expres
         // Handle numbers
         if (std::isdigit(c) || c == '.') {
             token = "";
-            while (i < expr.length() && (std::isdigit(expr[i]) || expr[i] == '.')) {
+            while (i < end && (std::isdigit(expr[i]) || expr[i] == '.')) {
                 token += expr[i++];
             }
             tokens.push_back(token);
@@ -114,41 +655,27 @@ std::vector<std::string> ExpressionEvaluator::tokenize(const std::string& expres
             continue;
         }
         
-        // Handle operators - check for multi-character operators first
-        bool isMultiChar = false;
-        for (const auto& op : multiCharOps) {
-            if (i + op.length() <= expr.length() && expr.substr(i, op.length()) == op) {
-                tokens.push_back(op);
-                i += op.length() - 1; // Skip characters
-                isMultiChar = true;
-                break;
-            }
-        }
-        
-        if (isMultiChar) continue;
-        
-        // Handle single-character operators
-        if (c == '+' || c == '-' || c == '*' || c == '/' || c == '%' || c == '^' ||
-            c == '<' || c == '>' || c == '=' || c == '!' ||
-            c == '&' || c == '|' || c == '~') {
+        // Handle operators - the longest registered symbol at this position
+        if (OperatorRegistry::isOperatorCharacter(c)) {
+            const OperatorDescriptor* op = registry.match(std::string_view(expr).substr(i, end - i));
             
-            // Handle unary operators at start of expression or after another operator or opening parenthesis
-            if ((c == '-' || c == '+' || c == '~' || c == '!') &&
-                (tokens.empty() || tokens.back() == "(" || isOperator(tokens.back()))) {
-                
-                // Convert + to nothing (unary plus doesn't change value)
-                if (c == '+') continue;
-                
-                // For unary operators, we treat them specially
-                if (c == '-') {
+            // Signs at start of expression or after another operator or opening parenthesis are unary
+            bool unaryPosition = tokens.empty() || tokens.back() == "(" || isOperator(tokens.back());
+            
+            if (op) {
+                i += op->symbol.length() - 1; // Skip characters
+                if (unaryPosition && op->id == OperatorDescriptor::ADD) {
+                    continue; // Unary plus doesn't change the value
+                }
+                if (unaryPosition && op->id == OperatorDescriptor::SUBTRACT) {
                     tokens.push_back("u-"); // Mark as unary minus
-                } else if (c == '~') {
-                    tokens.push_back("~");
-                } else if (c == '!') {
-                    tokens.push_back("not");
+                } else {
+                    tokens.push_back(std::string(op->symbol));
                 }
-            } else {
-                tokens.push_back(std::string(1, c));
+            } else if (c == '!') {
+                tokens.push_back(unaryPosition ? "not" : "!");
+            } else if (c == '=') {
+                tokens.push_back("=");
             }
             continue;
         }
@@ -156,31 +683,30 @@ std::vector<std::string> ExpressionEvaluator::tokenize(const std::string& expres
         // Handle alphabetic characters (for variables or function names)
         if (std::isalpha(c)) {
             token = "";
-            while (i < expr.length() && (std::isalnum(expr[i]) || expr[i] == '_')) {
+            while (i < end && (std::isalnum(expr[i]) || expr[i] == '_')) {
                 token += expr[i++];
             }
             --i; // Move back one step since the for loop will increment
             
-            // Handle 'not' keyword
-            if (token == "not") {
-                tokens.push_back("not");
-            } else {
-                tokens.push_back(token); // For future variable support
-            }
+            // Replace keywords with their operator symbols ("and" -> "&&");
+            // other names are variables
+            const OperatorDescriptor* op = registry.find(token);
+            tokens.push_back(op ? std::string(registry.canonical(*op).symbol) : token);
             continue;
         }
     }
-    
-    return tokens;
 }
 
-// Convert infix expression to postfix using the Shunting Yard algorithm
-std::vector<std::string> ExpressionEvaluator::infixToPostfix(const std::vector<std::string>& tokens) {
-    std::vector<std::string> postfix;
-    std::stack<std::string> operators;
+// Convert infix expression to postfix using the Shunting Yard algorithm.
+// Each token is looked up in the operator registry once; the stack holds
+// descriptors, with nullptr standing for a left parenthesis.
+ExpressionError::Code ExpressionEvaluator::infixToPostfix(const std::vector<std::string>& tokens,
+                                                          std::vector<std::string>& postfix) const {
+    std::stack<const OperatorDescriptor*> operators;
     
     for (size_t i = 0; i < tokens.size(); ++i) {
         const std::string& token = tokens[i];
+        const OperatorDescriptor* op = nullptr;
         
         // If token is a number, add it to the output
         if (isNumber(token)) {
@@ -188,37 +714,37 @@ std::vector<std::string> ExpressionEvaluator::infixToPostfix(const std::vector<s
         }
         // If token is a left parenthesis, push it onto the stack
         else if (token == "(") {
-            operators.push(token);
+            operators.push(nullptr);
         }
         // If token is a right parenthesis, pop operators from stack and add to output until left parenthesis
         else if (token == ")") {
-            while (!operators.empty() && operators.top() != "(") {
-                postfix.push_back(operators.top());
+            while (!operators.empty() && operators.top()) {
+                postfix.push_back(std::string(operators.top()->symbol));
                 operators.pop();
             }
             
-            if (!operators.empty() && operators.top() == "(") {
+            if (!operators.empty()) {
                 operators.pop(); // Discard the left parenthesis
             } else {
-                throw ExpressionError("Error: Mismatched parentheses");
+                return ExpressionError::MISMATCHED_PARENTHESES;
             }
         }
         // If token is an operator
-        else if (isOperator(token)) {
-            // Handle special case for unary operators
-            if (token == "u-" || token == "~" || token == "not") {
-                operators.push(token);
+        else if ((op = registry.find(token))) {
+            // Prefix operators wait for their operand
+            if (op->isUnary()) {
+                operators.push(op);
             } else {
-                while (!operators.empty() && operators.top() != "(" &&
-                       ((isRightAssociative(token) && getPrecedence(token) < getPrecedence(operators.top())) ||
-                        (!isRightAssociative(token) && getPrecedence(token) <= getPrecedence(operators.top())))) {
-                    postfix.push_back(operators.top());
+                while (!operators.empty() && operators.top() &&
+                       ((op->rightAssociative && op->precedence < operators.top()->precedence) ||
+                        (!op->rightAssociative && op->precedence <= operators.top()->precedence))) {
+                    postfix.push_back(std::string(operators.top()->symbol));
                     operators.pop();
                 }
-                operators.push(token);
+                operators.push(op);
             }
         }
-        // Handle variable names or function calls (future enhancement)
+        // Handle variable names
         else {
             postfix.push_back(token);
         }
@@ -226,66 +752,108 @@ std::vector<std::string> ExpressionEvaluator::infixToPostfix(const std::vector<s
     
     // Pop any remaining operators from the stack and add to output
     while (!operators.empty()) {
-        if (operators.top() == "(") {
-            throw ExpressionError("Error: Mismatched parentheses");
+        if (!operators.top()) {
+            return ExpressionError::MISMATCHED_PARENTHESES;
         }
-        postfix.push_back(operators.top());
+        postfix.push_back(std::string(operators.top()->symbol));
         operators.pop();
     }
     
-    return postfix;
+    return ExpressionError::NONE;
 }
 
 // Build the expression tree from postfix notation
-NodePtr ExpressionEvaluator::buildTreeFromPostfix(const std::vector<std::string>& postfix) {
+ExpressionError::Code ExpressionEvaluator::buildTreeFromPostfix(const std::vector<std::string>& postfix,
+                                                                NodePtr& root) const {
     std::stack<NodePtr> nodeStack;
     
     for (const std::string& token : postfix) {
         if (isNumber(token)) {
+            // Plain digit literals are exact 64-bit integers when they fit. Too
+            // large for int64, or anything else strtod accepts (inf, nan,
+            // exponents): keep it as a double.
+            if (token.find_first_of(".eE") == std::string::npos) {
+                errno = 0;
+                char* end = nullptr;
+                long long integer = std::strtoll(token.c_str(), &end, 10);
+                if (end == token.c_str() + token.size() && errno != ERANGE) {
+                    nodeStack.push(std::make_shared<Node>(integer));
+                    continue;
+                }
+            }
+            
             // Convert the token to a double
-            double value = std::stod(token);
+            double value = std::strtod(token.c_str(), nullptr);
             nodeStack.push(std::make_shared<Node>(value));
         }
-        // Handle unary operators
-        else if (isUnaryOperator(token)) {
-            if (nodeStack.empty()) {
-                throw ExpressionError("Error: Invalid expression syntax for unary operator");
-            }
-            
-            NodePtr right = nodeStack.top();
-            nodeStack.pop();
-            
-            // Create a unary operator node
-            std::string opStr = (token == "u-") ? "-" : token; // Convert u- back to -
-            nodeStack.push(std::make_shared<Node>(opStr, right));
-        }
-        // Handle binary operators
-        else if (isOperator(token)) {
-            if (nodeStack.size() < 2) {
-                throw ExpressionError("Error: Invalid expression syntax for binary operator");
+        // Handle operators
+        else if (const OperatorDescriptor* op = registry.find(token)) {
+            if (op->isUnary()) {
+                if (nodeStack.empty()) {
+                    return ExpressionError::INVALID_UNARY_SYNTAX;
+                }
+                
+                NodePtr right = nodeStack.top();
+                nodeStack.pop();
+                
+                // Create a unary operator node
+                nodeStack.push(makeUnaryNode(*op, right));
+            } else {
+                if (nodeStack.size() < 2) {
+                    return ExpressionError::INVALID_BINARY_SYNTAX;
+                }
+                
+                NodePtr right = nodeStack.top();
+                nodeStack.pop();
+                NodePtr left = nodeStack.top();
+                nodeStack.pop();
+                
+                // Create a binary operator node
+                nodeStack.push(makeBinaryNode(*op, left, right));
             }
-            
-            NodePtr right = nodeStack.top();
-            nodeStack.pop();
-            NodePtr left = nodeStack.top();
-            nodeStack.pop();
-            
-            // Create a binary operator node
-            nodeStack.push(std::make_shared<Node>(token, left, right));
+        }
+        // Handle variable names
+        else if (std::isalpha(static_cast<unsigned char>(token[0]))) {
+            nodeStack.push(std::make_shared<Node>(token));
         }
     }
     
     if (nodeStack.size() != 1) {
-        throw ExpressionError("Error: Invalid expression");
+        return ExpressionError::INVALID_EXPRESSION;
     }
     
-    return nodeStack.top();
+    root = nodeStack.top();
+    return ExpressionError::NONE;
+}
+
+// Create a binary operator node and infer its type (see yieldsInteger)
+NodePtr ExpressionEvaluator::makeBinaryNode(const OperatorDescriptor& op, NodePtr left, NodePtr right) const {
+    NodePtr node = std::make_shared<Node>(std::string(op.symbol), left, right);
+    if (yieldsInteger(op, left->isInteger(), right->isInteger())) node->setValueType(Node::INTEGER);
+    return node;
+}
+
+// Create a unary operator node: negation keeps its operand's type (and is
+// spelled "-" in the tree), '~' and 'not' always yield integers
+NodePtr ExpressionEvaluator::makeUnaryNode(const OperatorDescriptor& op, NodePtr right) const {
+    std::string symbol = (op.id == OperatorDescriptor::NEGATE) ? "-" : std::string(op.symbol);
+    NodePtr node = std::make_shared<Node>(symbol, right);
+    if (yieldsInteger(op, right->isInteger(), right->isInteger())) node->setValueType(Node::INTEGER);
+    return node;
 }
 
 // Evaluate a node in the expression tree
-double ExpressionEvaluator::evaluateNode(NodePtr node) {
+template <class Probe>
+double ExpressionEvaluator::evaluateNode(NodePtr node, ExpressionError::Code& error, Probe& probe) const {
+    // Integer subtrees run on the int64 kernels; convert at the type boundary
+    if (node && node->isInteger()) {
+        return evaluateIntegerNode(node, error, probe).toDouble();
+    }
+    
+    typename Probe::Scope scope(probe, node.get(), error);
     if (!node) {
-        throw ExpressionError("Error: Null node encountered during evaluation");
+        error = ExpressionError::NULL_NODE;
+        return std::nan("");
     }
     
     // If the node is an operand, return its value
@@ -293,92 +861,404 @@ double ExpressionEvaluator::evaluateNode(NodePtr node) {
         return node->getValue();
     }
     
+    // If the node is a variable, look up its binding
+    if (node->isVariable()) {
+        auto it = variables.find(node->getName());
+        if (it != variables.end()) {
+            return it->second;
+        }
+        error = ExpressionError::UNKNOWN_VARIABLE;
+        return std::nan("");
+    }
+    
+    const OperatorDescriptor* op = node->isUnaryOp() ? registry.findUnary(node->getOperator())
+                                                     : registry.find(node->getOperator());
+    if (!op) {
+        error = ExpressionError::UNKNOWN_OPERATOR;
+        return std::nan("");
+    }
+    
     // If the node is a unary operator
     if (node->isUnaryOp()) {
-        std::string op = node->getOperator();
-        double rightValue = evaluateNode(node->getRight());
-        
-        // Check if the operator exists in our unary operators map
-        auto it = unaryOps.find(op);
-        if (it != unaryOps.end()) {
-            return it->second(rightValue);
-        }
-        
-        throw ExpressionError("Error: Unknown unary operator '" + op + "'");
+        double rightValue = evaluateNode(node->getRight(), error, probe);
+        if (error != ExpressionError::NONE) return rightValue;
+        return applyUnary(*op, rightValue, error);
     }
     
     // If the node is a binary operator
-    double leftValue = evaluateNode(node->getLeft());
-    double rightValue = evaluateNode(node->getRight());
-    std::string op = node->getOperator();
+    double leftValue = evaluateNode(node->getLeft(), error, probe);
+    if (error != ExpressionError::NONE) return leftValue;
+    probe.shortCircuit(*op, leftValue, *node);
+    double rightValue = evaluateNode(node->getRight(), error, probe);
+    if (error != ExpressionError::NONE) return rightValue;
+    return applyBinary(*op, leftValue, rightValue, error);
+}
+
+// Evaluate a node inferred as INTEGER. Operands are evaluated by their own
+// type; the result falls back to double only if an operand turned out to be
+// a double (e.g. 2^-1) or the exact result overflows 64 bits.
+template <class Probe>
+ExpressionEvaluator::Value ExpressionEvaluator::evaluateIntegerNode(NodePtr node, ExpressionError::Code& error,
+                                                                    Probe& probe) const {
+    const Value failed{false, 0, std::nan("")};
+    typename Probe::Scope scope(probe, node.get(), error);
+    if (node->isOperand()) {
+        return Value{true, node->getIntegerValue(), 0};
+    }
     
-    // Check if the operator exists in our binary operators map
-    auto it = binaryOps.find(op);
-    if (it != binaryOps.end()) {
-        return it->second(leftValue, rightValue);
+    auto operand = [this, &error, &probe](NodePtr child) {
+        if (!child) {
+            error = ExpressionError::NULL_NODE;
+            return Value{false, 0, std::nan("")};
+        }
+        return child->isInteger() ? evaluateIntegerNode(child, error, probe)
+                                  : Value{false, 0, evaluateNode(child, error, probe)};
+    };
+    
+    const OperatorDescriptor* op = node->isUnaryOp() ? registry.findUnary(node->getOperator())
+                                                     : registry.find(node->getOperator());
+    if (!op) {
+        error = ExpressionError::UNKNOWN_OPERATOR;
+        return failed;
     }
     
-    throw ExpressionError("Error: Unknown binary operator '" + op + "'");
+    if (node->isUnaryOp()) {
+        Value value = operand(node->getRight());
+        if (error != ExpressionError::NONE) return failed;
+        return applyIntegerUnary(*op, value, error);
+    }
+    
+    Value left = operand(node->getLeft());
+    if (error != ExpressionError::NONE) return failed;
+    probe.shortCircuit(*op, left.toDouble(), *node);
+    Value right = operand(node->getRight());
+    if (error != ExpressionError::NONE) return failed;
+    return applyIntegerBinary(*op, left, right, error);
 }
 
-// Return the precedence of an operator
-int ExpressionEvaluator::getPrecedence(const std::string& op) {
-    if (op == "u-" || op == "~" || op == "not") {
-        return 8; // Unary operators have highest precedence
-    } else if (op == "^") {
-        return 7; // Power operator has next highest precedence
-    } else if (op == "*" || op == "/" || op == "%") {
-        return 6;
-    } else if (op == "+" || op == "-") {
-        return 5;
-    } else if (op == "<<" || op == ">>") {
-        return 4;
-    } else if (op == "<" || op == ">" || op == "<=" || op == ">=") {
-        return 3;
-    } else if (op == "==" || op == "!=") {
-        return 2;
-    } else if (op == "&" || op == "xor" || op == "|" || op == "&&" || op == "||" || op == "and" || op == "or") {
-        return 1;
+// Apply a unary operator of a FLOAT node
+double ExpressionEvaluator::applyUnary(const OperatorDescriptor& op, double operand, ExpressionError::Code& error) {
+    if (op.unary) {
+        return op.unary(operand);
     }
-    return 0; // Default precedence for unknown operators
+    
+    error = ExpressionError::UNKNOWN_OPERATOR;
+    return std::nan("");
 }
 
-// Check if a string is a valid operator
-bool ExpressionEvaluator::isOperator(const std::string& token) {
-    static const std::vector<std::string> operators = {
-        "+", "-", "*", "/", "%", "^",
-        "==", "!=", "<", ">", "<=", ">=",
-        "&&", "||", "&", "|", "xor", "<<", ">>", "~",
-        "u-", "not", "and", "or"
+// Apply a binary operator of a FLOAT node
+double ExpressionEvaluator::applyBinary(const OperatorDescriptor& op, double left, double right,
+                                        ExpressionError::Code& error) {
+    if (right == 0 && (op.id == OperatorDescriptor::DIVIDE || op.id == OperatorDescriptor::MODULO)) {
+        error = (op.id == OperatorDescriptor::DIVIDE) ? ExpressionError::DIVISION_BY_ZERO
+                                                      : ExpressionError::MODULO_BY_ZERO;
+        return std::nan("");
+    }
+    
+    if (op.binary) {
+        return op.binary(left, right);
+    }
+    
+    error = ExpressionError::UNKNOWN_OPERATOR;
+    return std::nan("");
+}
+
+// Apply a unary operator of an INTEGER node
+ExpressionEvaluator::Value ExpressionEvaluator::applyIntegerUnary(const OperatorDescriptor& op, Value value,
+                                                                  ExpressionError::Code& error) {
+    switch (op.id) {
+    case OperatorDescriptor::NEGATE:
+        if (value.isInteger && value.integer != LLONG_MIN) return Value{true, -value.integer, 0};
+        return Value{false, 0, -value.toDouble()};
+    case OperatorDescriptor::LOGICAL_NOT:
+        return Value{true, value.isInteger ? value.integer == 0 : value.real == 0, 0};
+    case OperatorDescriptor::BIT_NOT: {
+        long long a = integerOperand(value, error);
+        if (error == ExpressionError::NONE) return Value{true, ~a, 0};
+        break;
+    }
+    default:
+        error = ExpressionError::UNKNOWN_OPERATOR;
+        break;
+    }
+    return Value{false, 0, std::nan("")};
+}
+
+// Apply a binary operator of an INTEGER node
+ExpressionEvaluator::Value ExpressionEvaluator::applyIntegerBinary(const OperatorDescriptor& op, Value left,
+                                                                   Value right, ExpressionError::Code& error) {
+    const Value failed{false, 0, std::nan("")};
+    long long result;
+    
+    if (op.category == OperatorDescriptor::BITWISE) {
+        long long a = integerOperand(left, error);
+        long long b = integerOperand(right, error);
+        if (error == ExpressionError::NONE && op.integer(a, b, result, error)) {
+            return Value{true, result, 0};
+        }
+        return failed;
+    }
+    if (left.isInteger && right.isInteger && op.integer) {
+        if (op.integer(left.integer, right.integer, result, error)) return Value{true, result, 0};
+        if (error != ExpressionError::NONE) return failed;
+    }
+    
+    // Mixed operands or overflow: use the double implementation
+    if (op.id == OperatorDescriptor::MODULO && right.toDouble() == 0) {
+        error = ExpressionError::MODULO_BY_ZERO;
+        return failed;
+    }
+    if (!op.binary) {
+        error = ExpressionError::UNKNOWN_OPERATOR;
+        return failed;
+    }
+    double value = op.binary(left.toDouble(), right.toDouble());
+    if (op.category == OperatorDescriptor::ARITHMETIC) {
+        return Value{false, 0, value};
+    }
+    return Value{true, static_cast<long long>(value), 0};
+}
+
+// Evaluate an expression while parsing it, with fixed-capacity operand and
+// operator stacks instead of token vectors and a tree, so the common case
+// performs no heap allocation. Operators are reduced in postfix order and
+// typed exactly as makeBinaryNode / makeUnaryNode would type them; errors are
+// prioritised as in the tree path (parentheses, then syntax, then the first
+// evaluation error). Returns false for inputs it does not handle (stack
+// capacity exceeded, overlong or malformed tokens, stray '=' or '!'); the
+// caller then uses the tree path.
+bool ExpressionEvaluator::evaluateDirect(const std::string& expr, Value& result, ExpressionError::Code& error) const {
+    const OperatorDescriptor* const OPEN = nullptr; // A left parenthesis on the operator stack
+    const OperatorDescriptor* negate = registry.find("u-");
+    const OperatorDescriptor* logicalNot = registry.find("not");
+    
+    // An operand and the static type of the node it stands for
+    struct Operand {
+        Value value;
+        bool isInteger;
+    };
+    const size_t CAPACITY = 64;
+    Operand operands[CAPACITY];
+    const OperatorDescriptor* operators[CAPACITY];
+    size_t operandCount = 0, operatorCount = 0;
+    ExpressionError::Code buildError = ExpressionError::NONE;
+    ExpressionError::Code evalError = ExpressionError::NONE;
+    char buffer[CAPACITY];
+    
+    // Pop the operands of op, apply it and push the result
+    auto reduce = [&](const OperatorDescriptor& op) {
+        if (buildError != ExpressionError::NONE) return;
+        ExpressionError::Code stepError = ExpressionError::NONE;
+        
+        if (op.isUnary()) {
+            if (operandCount < 1) {
+                buildError = ExpressionError::INVALID_UNARY_SYNTAX;
+                return;
+            }
+            Operand& operand = operands[operandCount - 1];
+            bool isInteger = yieldsInteger(op, operand.isInteger, operand.isInteger);
+            if (isInteger) {
+                operand.value = applyIntegerUnary(op, operand.value, stepError);
+            } else {
+                operand.value = Value{false, 0, applyUnary(op, operand.value.toDouble(), stepError)};
+            }
+            operand.isInteger = isInteger;
+        } else {
+            if (operandCount < 2) {
+                buildError = ExpressionError::INVALID_BINARY_SYNTAX;
+                return;
+            }
+            Operand& left = operands[operandCount - 2];
+            const Operand& right = operands[operandCount - 1];
+            bool isInteger = yieldsInteger(op, left.isInteger, right.isInteger);
+            if (isInteger) {
+                left.value = applyIntegerBinary(op, left.value, right.value, stepError);
+            } else {
+                left.value = Value{false, 0, applyBinary(op, left.value.toDouble(), right.value.toDouble(), stepError)};
+            }
+            left.isInteger = isInteger;
+            --operandCount;
+        }
+        if (evalError == ExpressionError::NONE) evalError = stepError;
     };
     
-    return std::find(operators.begin(), operators.end(), token) != operators.end();
+    auto pushOperand = [&](Value value, bool isInteger) {
+        if (operandCount == CAPACITY) return false;
+        operands[operandCount++] = Operand{value, isInteger};
+        return true;
+    };
+    
+    // Push an operator; a binary operator first reduces those that bind at least as tightly
+    auto pushOperator = [&](const OperatorDescriptor* op) {
+        while (op && !op->isUnary() && operatorCount > 0 && operators[operatorCount - 1] != OPEN &&
+               ((op->rightAssociative && op->precedence < operators[operatorCount - 1]->precedence) ||
+                (!op->rightAssociative && op->precedence <= operators[operatorCount - 1]->precedence))) {
+            reduce(*operators[--operatorCount]);
+        }
+        if (operatorCount == CAPACITY) return false;
+        operators[operatorCount++] = op;
+        return true;
+    };
+    
+    bool afterOperand = false; // Previous token was a number, variable or ')'
+    for (size_t i = 0; i < expr.length(); ++i) {
+        char c = expr[i];
+        
+        if (std::isspace(static_cast<unsigned char>(c))) {
+            continue;
+        }
+        
+        // Numbers
+        if (std::isdigit(static_cast<unsigned char>(c)) || c == '.') {
+            size_t length = 0;
+            bool hasPoint = false;
+            while (i < expr.length() && (std::isdigit(static_cast<unsigned char>(expr[i])) || expr[i] == '.')) {
+                if (length + 1 == CAPACITY) return false;
+                hasPoint = hasPoint || expr[i] == '.';
+                buffer[length++] = expr[i++];
+            }
+            buffer[length] = '\0';
+            --i;
+            
+            char* end = nullptr;
+            double real = std::strtod(buffer, &end);
+            if (end != buffer + length) return false;
+            
+            errno = 0;
+            long long integer = hasPoint ? 0 : std::strtoll(buffer, nullptr, 10);
+            bool fits = !hasPoint && errno != ERANGE;
+            if (!pushOperand(fits ? Value{true, integer, 0} : Value{false, 0, real}, fits)) return false;
+            afterOperand = true;
+            continue;
+        }
+        
+        if (c == '(') {
+            if (!pushOperator(OPEN)) return false;
+            afterOperand = false;
+            continue;
+        }
+        if (c == ')') {
+            while (operatorCount > 0 && operators[operatorCount - 1] != OPEN) {
+                reduce(*operators[--operatorCount]);
+            }
+            if (operatorCount == 0) {
+                error = ExpressionError::MISMATCHED_PARENTHESES;
+                return true;
+            }
+            --operatorCount;
+            afterOperand = true;
+            continue;
+        }
+        
+        // Operators, with the same unary rules as tokenizeRange
+        if (OperatorRegistry::isOperatorCharacter(c)) {
+            const OperatorDescriptor* op = registry.match(std::string_view(expr).substr(i));
+            if (op) {
+                i += op->symbol.length() - 1;
+            } else if (c == '!' && !afterOperand) {
+                op = logicalNot;
+            } else if (c == '!' || c == '=') {
+                return false; // Stray token, ignored by the tree path
+            } else {
+                continue; // Any other character is skipped, as in tokenizeRange
+            }
+            
+            if (!afterOperand && op->id == OperatorDescriptor::ADD) {
+                continue; // Unary plus doesn't change the value
+            }
+            if (!afterOperand && op->id == OperatorDescriptor::SUBTRACT) {
+                op = negate;
+            }
+            if (!pushOperator(op)) return false;
+            afterOperand = false;
+            continue;
+        }
+        
+        // Keywords and variables
+        if (std::isalpha(static_cast<unsigned char>(c))) {
+            size_t start = i;
+            while (i < expr.length() && (std::isalnum(static_cast<unsigned char>(expr[i])) || expr[i] == '_')) {
+                ++i;
+            }
+            std::string_view word(expr.data() + start, i - start);
+            --i;
+            
+            if (const OperatorDescriptor* op = registry.find(word)) {
+                if (!pushOperator(&registry.canonical(*op))) return false;
+                afterOperand = false;
+            } else {
+                // Words such as "inf" or "nan" are numbers in the tree path
+                if (word.length() + 1 >= CAPACITY) return false;
+                word.copy(buffer, word.length());
+                buffer[word.length()] = '\0';
+                char* end = nullptr;
+                std::strtod(buffer, &end);
+                if (end != buffer) return false;
+                
+                auto it = variables.find(word);
+                if (it == variables.end() && evalError == ExpressionError::NONE) {
+                    evalError = ExpressionError::UNKNOWN_VARIABLE;
+                }
+                Value value{false, 0, it != variables.end() ? it->second : std::nan("")};
+                if (!pushOperand(value, false)) return false;
+                afterOperand = true;
+            }
+            continue;
+        }
+        
+        // Any other character is skipped, as in tokenizeRange
+    }
+    
+    while (operatorCount > 0) {
+        if (operators[operatorCount - 1] == OPEN) {
+            error = ExpressionError::MISMATCHED_PARENTHESES;
+            return true;
+        }
+        reduce(*operators[--operatorCount]);
+    }
+    
+    if (buildError != ExpressionError::NONE) {
+        error = buildError;
+    } else if (operandCount != 1) {
+        error = ExpressionError::INVALID_EXPRESSION;
+    } else {
+        error = evalError;
+        result = operands[0].value;
+    }
+    return true;
+}
+
+// Return the precedence of an operator (0 for anything else)
+int ExpressionEvaluator::getPrecedence(const std::string& op) const {
+    const OperatorDescriptor* descriptor = registry.find(op);
+    return descriptor ? descriptor->precedence : 0;
+}
+
+// Check if a string is a valid operator
+bool ExpressionEvaluator::isOperator(const std::string& token) const {
+    return registry.find(token) != nullptr;
 }
 
 // Check if an operator is unary
-bool ExpressionEvaluator::isUnaryOperator(const std::string& token) {
-    static const std::vector<std::string> unaryOps = {"u-", "~", "not"};
-    return std::find(unaryOps.begin(), unaryOps.end(), token) != unaryOps.end();
+bool ExpressionEvaluator::isUnaryOperator(const std::string& token) const {
+    const OperatorDescriptor* descriptor = registry.find(token);
+    return descriptor && descriptor->isUnary();
 }
 
 // Check if an operator is right-associative
-bool ExpressionEvaluator::isRightAssociative(const std::string& op) {
-    // Most operators in C++ are left-associative
-    // Exponentiation, unary operators, and assignment operators are right-associative
-    static const std::vector<std::string> rightAssociative = {"^", "u-", "~", "not"};
-    return std::find(rightAssociative.begin(), rightAssociative.end(), op) != rightAssociative.end();
+bool ExpressionEvaluator::isRightAssociative(const std::string& op) const {
+    const OperatorDescriptor* descriptor = registry.find(op);
+    return descriptor && descriptor->rightAssociative;
 }
 
 // Check if a token is a number
-bool ExpressionEvaluator::isNumber(const std::string& token) {
+bool ExpressionEvaluator::isNumber(const std::string& token) const {
     if (token.empty()) return false;
     
-    // Check if the token is a valid floating-point number
-    try {
-        std::size_t pos = 0;
-        std::stod(token, &pos);
-        return pos == token.length();
-    } catch (const std::exception&) {
-        return false;
-    }
-}
\ No newline at end of file
+    // Check if the token is a valid floating-point number (strtod reports
+    // failure through the end pointer rather than an exception)
+    const char* begin = token.c_str();
+    char* end = nullptr;
+    std::strtod(begin, &end);
+    return end != begin && static_cast<size_t>(end - begin) == token.length();
+}
@@ -2,10 +2,15 @@
 #define EXPRESSION_EVALUATOR_HPP
 
 #include "ExpressionTree.hpp"
+#include "OperatorRegistry.hpp"
 #include <string>
 #include <vector>
 #include <map>
-#include <functional>
+#include <unordered_map>
+#include <cstddef>
+#include <cstdint>
+
+class ExpressionProfile;
 
 /**
  * Class to handle expression evaluation and parsing
@@ -14,48 +19,199 @@
  */
 class ExpressionEvaluator {
 public:
+    // Result of evaluation with its dynamic type. Integer subtrees stay exact
+    // 64-bit values; they become doubles only when mixed with floating point
+    // operands, divided, or on overflow.
+    struct Value {
+        bool isInteger;
+        long long integer;
+        double real;
+        
+        double toDouble() const { return isInteger ? static_cast<double>(integer) : real; }
+    };
+    
+    // Per-row results of a batch evaluation. Failed rows hold NaN in values,
+    // their error code in errors and a set bit in errorBitmap. Evaluators
+    // that keep integer results exact (ColumnStore) also fill integers and
+    // integerBitmap: a set bit means integers[row] is the exact result that
+    // values[row] may have rounded. They are empty otherwise.
+    struct BatchResult {
+        std::vector<double> values;
+        std::vector<ExpressionError::Code> errors;
+        std::vector<uint64_t> errorBitmap;
+        size_t errorCount = 0;
+        std::vector<long long> integers;
+        std::vector<uint64_t> integerBitmap;
+        
+        bool hasError(size_t row) const { return (errorBitmap[row / 64] >> (row % 64)) & 1; }
+        bool isInteger(size_t row) const {
+            return !integerBitmap.empty() && ((integerBitmap[row / 64] >> (row % 64)) & 1);
+        }
+        
+        // Result of a successful row with its type
+        Value valueAt(size_t row) const {
+            return isInteger(row) ? Value{true, integers[row], 0} : Value{false, 0, values[row]};
+        }
+    };
+    
     ExpressionEvaluator();
     
     // Parse an expression and build the expression tree
-    ExpressionTree buildExpressionTree(const std::string& expression);
+    ExpressionTree buildExpressionTree(const std::string& expression) const;
     
     // Evaluate the expression tree and return the result
-    double evaluate(const ExpressionTree& tree);
+    double evaluate(const ExpressionTree& tree) const;
     
     // Direct evaluation from expression string
-    double evaluate(const std::string& expression);
+    double evaluate(const std::string& expression) const;
+    
+    // Evaluate the expression tree, keeping integer results exact
+    Value evaluateValue(const ExpressionTree& tree) const;
+    
+    // Bind a value to a variable used by subsequent evaluations
+    void setVariable(const std::string& name, double value);
+    void clearVariables();
+    
+    // Register a custom binary or prefix operator; it is recognised by the
+    // lexer, parser and evaluators alike (see OperatorRegistry). Throws
+    // ExpressionError for an invalid or already registered symbol.
+    void registerOperator(const std::string& symbol, int precedence, bool rightAssociative,
+                          OperatorDescriptor::BinaryKernel kernel);
+    void registerOperator(const std::string& symbol, OperatorDescriptor::UnaryKernel kernel);
+    
+    // The operators known to this evaluator
+    const OperatorRegistry& getOperators() const { return registry; }
+    
+    // Non-throwing API: errors are returned as codes instead of exceptions,
+    // so failing inputs never unwind the stack. The functions above are thin
+    // wrappers that throw ExpressionError for a non-NONE code.
+    ExpressionError::Code tryBuildExpressionTree(const std::string& expression, ExpressionTree& tree) const;
+    ExpressionError::Code tryEvaluate(const ExpressionTree& tree, Value& result) const;
+    ExpressionError::Code tryEvaluate(const std::string& expression, Value& result) const;
+    ExpressionError::Code tryBuildExpressionTreeParallel(const std::string& expression, ExpressionTree& tree,
+                                                         size_t threadCount = 0) const;
+    
+    // Evaluate the tree of profile, adding per-node counts and timings to it
+    // (see ExpressionProfile). The overloads above carry no profiling code.
+    ExpressionError::Code tryEvaluate(ExpressionProfile& profile, Value& result) const;
+    
+    // Evaluate many rows without throwing; see BatchResult
+    BatchResult evaluateBatch(const std::vector<ExpressionTree>& trees) const;
+    BatchResult evaluateBatch(const std::vector<std::string>& expressions) const;
+    
+    // Parse a very large expression using several threads. Inputs shorter than
+    // PARALLEL_PARSE_THRESHOLD, or without a splittable top-level operator,
+    // fall back to buildExpressionTree. Errors are those of buildExpressionTree.
+    // threadCount 0 means hardware concurrency.
+    ExpressionTree buildExpressionTreeParallel(const std::string& expression, size_t threadCount = 0) const;
+    
+    // Reshape every chain of one associative operator, such as the left-deep
+    // x1 + x2 + ... + xN the parser builds, into a balanced tree of depth
+    // log N with the operands in their original order. The input is not
+    // modified; untouched subtrees are shared. With strictFloatingPoint only
+    // && and || chains are rebalanced, whose results and errors cannot
+    // change. Without it + * & | xor chains are rebalanced too: sums and
+    // products may round differently or overflow int64 at a different point,
+    // and when several operands fail a different error may be reported.
+    ExpressionTree rebalance(const ExpressionTree& tree, bool strictFloatingPoint = true) const;
+    
+    // Evaluate a tree on several threads: the independent subtrees a few
+    // levels below the root are evaluated concurrently, then the operators
+    // above them. Gives the same result and error as tryEvaluate. Trees of
+    // fewer than PARALLEL_EVALUATE_THRESHOLD nodes are evaluated directly.
+    // A left-deep chain leaves nearly all work in one subtree; rebalance it
+    // first. threadCount 0 means hardware concurrency.
+    ExpressionError::Code tryEvaluateParallel(const ExpressionTree& tree, Value& result, size_t threadCount = 0) const;
+    
+    // Format a result for display: integers without decimals, otherwise 6 decimals
+    static std::string formatResult(double result);
+    static std::string formatResult(const Value& result);
+    
+    // Minimum input length (in characters) for which parallel parsing is used
+    static const size_t PARALLEL_PARSE_THRESHOLD = 256 * 1024;
+    
+    // Minimum tree size (in nodes) for which parallel evaluation is used
+    static const size_t PARALLEL_EVALUATE_THRESHOLD = 16 * 1024;
     
 private:
+    friend class CompiledExpression; // Shares the operator kernels
+    
     // Tokenizes the input expression into tokens
-    std::vector<std::string> tokenize(const std::string& expression);
+    std::vector<std::string> tokenize(const std::string& expression) const;
+    
+    // Tokenizes expression[begin, end) and appends the tokens
+    void tokenizeRange(const std::string& expression, size_t begin, size_t end,
+                       std::vector<std::string>& tokens) const;
     
     // Converts infix expression to postfix notation using Shunting Yard algorithm
-    std::vector<std::string> infixToPostfix(const std::vector<std::string>& tokens);
+    ExpressionError::Code infixToPostfix(const std::vector<std::string>& tokens,
+                                         std::vector<std::string>& postfix) const;
     
     // Builds the expression tree from postfix notation
-    NodePtr buildTreeFromPostfix(const std::vector<std::string>& postfix);
+    ExpressionError::Code buildTreeFromPostfix(const std::vector<std::string>& postfix, NodePtr& root) const;
+    
+    // Creates operator nodes, inferring their value type from the operator
+    // and the operand types
+    NodePtr makeBinaryNode(const OperatorDescriptor& op, NodePtr left, NodePtr right) const;
+    NodePtr makeUnaryNode(const OperatorDescriptor& op, NodePtr right) const;
+    
+    // Rebalances the chains in the subtree of node (see rebalance)
+    NodePtr rebalanceNode(const NodePtr& node, bool strictFloatingPoint) const;
     
-    // Evaluates a node in the expression tree
-    double evaluateNode(NodePtr node);
+    // Result of a subtree evaluated by a tryEvaluateParallel worker
+    struct SubtreeResult {
+        Value value;
+        ExpressionError::Code error;
+    };
+    
+    // Evaluates the operators above the subtrees tryEvaluateParallel has
+    // already evaluated, taking their results from done
+    Value evaluateAbove(const NodePtr& node, const std::unordered_map<const Node*, SubtreeResult>& done,
+                        ExpressionError::Code& error) const;
+    
+    // Evaluates a node in the expression tree. On failure sets error and
+    // returns NaN; callers stop as soon as error is set. Probe is either a
+    // no-op or an ExpressionProfile observing every node.
+    template <class Probe>
+    double evaluateNode(NodePtr node, ExpressionError::Code& error, Probe& probe) const;
+    
+    // Evaluates a node inferred as INTEGER with the int64 kernels
+    template <class Probe>
+    Value evaluateIntegerNode(NodePtr node, ExpressionError::Code& error, Probe& probe) const;
+    
+    // Operator kernels shared by tree evaluation, evaluateDirect and
+    // CompiledExpression: the double versions for FLOAT nodes, the Value
+    // versions for INTEGER nodes
+    static double applyUnary(const OperatorDescriptor& op, double operand, ExpressionError::Code& error);
+    static double applyBinary(const OperatorDescriptor& op, double left, double right, ExpressionError::Code& error);
+    static Value applyIntegerUnary(const OperatorDescriptor& op, Value operand, ExpressionError::Code& error);
+    static Value applyIntegerBinary(const OperatorDescriptor& op, Value left, Value right,
+                                    ExpressionError::Code& error);
+    
+    // Evaluates an expression during parsing without building a tree;
+    // returns false if the input needs the tree path
+    bool evaluateDirect(const std::string& expression, Value& result, ExpressionError::Code& error) const;
     
     // Returns the precedence of an operator
-    int getPrecedence(const std::string& op);
+    int getPrecedence(const std::string& op) const;
     
     // Checks if a string is a valid operator
-    bool isOperator(const std::string& token);
+    bool isOperator(const std::string& token) const;
     
     // Checks if an operator is unary
-    bool isUnaryOperator(const std::string& token);
+    bool isUnaryOperator(const std::string& token) const;
     
     // Checks if an operator is right-associative
-    bool isRightAssociative(const std::string& op);
+    bool isRightAssociative(const std::string& op) const;
     
     // Checks if a token is a number
-    bool isNumber(const std::string& token);
+    bool isNumber(const std::string& token) const;
+    
+    // Operator descriptors and their implementations
+    OperatorRegistry registry;
     
-    // Maps for operators and their implementations
-    std::map<std::string, std::function<double(double, double)>> binaryOps;
-    std::map<std::string, std::function<double(double)>> unaryOps;
+    // Current variable bindings (transparent comparator: lookups by string_view)
+    std::map<std::string, double, std::less<>> variables;
 };
 
 #endif // EXPRESSION_EVALUATOR_HPP
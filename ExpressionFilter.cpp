@@ -0,0 +1,495 @@
+#include "ExpressionFilter.hpp"
+#include <algorithm>
+#include <chrono>
+#include <limits>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// Compare-and-mask lanes: one vector compare yields a bit per row
+#if defined(__AVX__)
+#define FILTER_LANES 1
+using Lanes = __m256d;
+const size_t LANE_COUNT = 4;
+inline Lanes load(const double* values) { return _mm256_loadu_pd(values); }
+inline Lanes broadcast(double value) { return _mm256_set1_pd(value); }
+inline uint64_t laneMask(Lanes mask) { return static_cast<uint64_t>(_mm256_movemask_pd(mask)); }
+#define LANE_COMPARE(avx, sse) static Lanes lanes(Lanes a, Lanes b) { return _mm256_cmp_pd(a, b, avx); }
+#elif defined(__SSE2__)
+#define FILTER_LANES 1
+using Lanes = __m128d;
+const size_t LANE_COUNT = 2;
+inline Lanes load(const double* values) { return _mm_loadu_pd(values); }
+inline Lanes broadcast(double value) { return _mm_set1_pd(value); }
+inline uint64_t laneMask(Lanes mask) { return static_cast<uint64_t>(_mm_movemask_pd(mask)); }
+#define LANE_COMPARE(avx, sse) static Lanes lanes(Lanes a, Lanes b) { return sse(a, b); }
+#else
+#define LANE_COMPARE(avx, sse)
+#endif
+
+// Comparison kernels. The vector predicates are ordered (false for NaN)
+// except !=, matching the scalar operators.
+#define COMPARISON(name, symbol, avx, sse) \
+    struct name { \
+        static bool scalar(double a, double b) { return a symbol b; } \
+        LANE_COMPARE(avx, sse) \
+    };
+
+COMPARISON(Equal, ==, _CMP_EQ_OQ, _mm_cmpeq_pd)
+COMPARISON(NotEqual, !=, _CMP_NEQ_UQ, _mm_cmpneq_pd)
+COMPARISON(Less, <, _CMP_LT_OQ, _mm_cmplt_pd)
+COMPARISON(Greater, >, _CMP_GT_OQ, _mm_cmpgt_pd)
+COMPARISON(LessEqual, <=, _CMP_LE_OQ, _mm_cmple_pd)
+COMPARISON(GreaterEqual, >=, _CMP_GE_OQ, _mm_cmpge_pd)
+
+#undef COMPARISON
+#undef LANE_COMPARE
+
+// Mask of left[i] <op> right[i] (or <op> constant if right is null) for i < count <= 64
+template <class Comparison>
+uint64_t compareWord(const double* left, const double* right, double constant, size_t count) {
+    uint64_t mask = 0;
+    size_t i = 0;
+#ifdef FILTER_LANES
+    if (right) {
+        for (; i + LANE_COUNT <= count; i += LANE_COUNT) {
+            mask |= laneMask(Comparison::lanes(load(left + i), load(right + i))) << i;
+        }
+    } else {
+        Lanes value = broadcast(constant);
+        for (; i + LANE_COUNT <= count; i += LANE_COUNT) {
+            mask |= laneMask(Comparison::lanes(load(left + i), value)) << i;
+        }
+    }
+#endif
+    for (; i < count; ++i) {
+        mask |= static_cast<uint64_t>(Comparison::scalar(left[i], right ? right[i] : constant)) << i;
+    }
+    return mask;
+}
+
+uint64_t compareWord(int comparison, const double* left, const double* right, double constant, size_t count) {
+    switch (comparison) {
+    case OperatorDescriptor::EQUAL: return compareWord<Equal>(left, right, constant, count);
+    case OperatorDescriptor::NOT_EQUAL: return compareWord<NotEqual>(left, right, constant, count);
+    case OperatorDescriptor::LESS: return compareWord<Less>(left, right, constant, count);
+    case OperatorDescriptor::GREATER: return compareWord<Greater>(left, right, constant, count);
+    case OperatorDescriptor::LESS_EQUAL: return compareWord<LessEqual>(left, right, constant, count);
+    default: return compareWord<GreaterEqual>(left, right, constant, count);
+    }
+}
+
+// Compare a single pair of values
+bool compareValues(int comparison, double a, double b) {
+    switch (comparison) {
+    case OperatorDescriptor::EQUAL: return a == b;
+    case OperatorDescriptor::NOT_EQUAL: return a != b;
+    case OperatorDescriptor::LESS: return a < b;
+    case OperatorDescriptor::GREATER: return a > b;
+    case OperatorDescriptor::LESS_EQUAL: return a <= b;
+    default: return a >= b;
+    }
+}
+
+// The comparison with its operands swapped (c < x is x > c)
+int mirrored(int comparison) {
+    switch (comparison) {
+    case OperatorDescriptor::LESS: return OperatorDescriptor::GREATER;
+    case OperatorDescriptor::GREATER: return OperatorDescriptor::LESS;
+    case OperatorDescriptor::LESS_EQUAL: return OperatorDescriptor::GREATER_EQUAL;
+    case OperatorDescriptor::GREATER_EQUAL: return OperatorDescriptor::LESS_EQUAL;
+    default: return comparison;
+    }
+}
+
+// Words with at most this many candidates are compared row by row
+const int SPARSE_WORD = 4;
+
+const OperatorDescriptor* descriptorOf(const NodePtr& node, const OperatorRegistry& operators) {
+    return node->isUnaryOp() ? operators.findUnary(node->getOperator()) : operators.find(node->getOperator());
+}
+
+bool hasVariables(const NodePtr& node) {
+    return node && (node->isVariable() || hasVariables(node->getLeft()) || hasVariables(node->getRight()));
+}
+
+// True if evaluating the subtree can fail for some input: a missing node, an
+// unknown operator, a zero divisor, or a bitwise operand out of range
+bool mayFail(const NodePtr& node, const OperatorRegistry& operators) {
+    if (!node) return true;
+    if (node->isOperand() || node->isVariable()) return false;
+    const OperatorDescriptor* op = descriptorOf(node, operators);
+    if (!op || op->category == OperatorDescriptor::DIVISION || op->category == OperatorDescriptor::BITWISE ||
+        op->id == OperatorDescriptor::MODULO) {
+        return true;
+    }
+    return (!node->isUnaryOp() && mayFail(node->getLeft(), operators)) || mayFail(node->getRight(), operators);
+}
+
+// The operands of a chain of the binary operator id (a && b && c -> a, b, c)
+void flatten(const NodePtr& node, int id, const OperatorRegistry& operators, std::vector<NodePtr>& operands) {
+    const OperatorDescriptor* op = (node && node->isOperator()) ? operators.find(node->getOperator()) : nullptr;
+    if (op && op->id == id) {
+        flatten(node->getLeft(), id, operators, operands);
+        flatten(node->getRight(), id, operators, operands);
+    } else {
+        operands.push_back(node);
+    }
+}
+
+} // namespace
+
+// Parse and plan a predicate
+ExpressionFilter::ExpressionFilter(const ExpressionEvaluator& evaluator, const std::string& predicate)
+    : ExpressionFilter(evaluator, evaluator.buildExpressionTree(predicate)) {
+}
+
+// Plan a parsed predicate
+ExpressionFilter::ExpressionFilter(const ExpressionEvaluator& evaluator, const ExpressionTree& tree) {
+    auto planned = std::make_shared<Plan>();
+    planned->variables = CompiledExpression(evaluator, tree).getVariables();
+    planned->root = planNode(tree.getRoot(), evaluator, *planned);
+    plan = planned;
+
+    adaptive = std::make_shared<Adaptive>();
+    adaptive->counters.reset(new Counters[plan->steps.size()]);
+    adaptive->order = plan->order;
+}
+
+// Choose how a subtree is evaluated
+int ExpressionFilter::planNode(NodePtr node, const ExpressionEvaluator& evaluator, Plan& plan) {
+    const OperatorRegistry& operators = evaluator.getOperators();
+    const OperatorDescriptor* op = (node && !node->isOperand() && !node->isVariable())
+                                       ? descriptorOf(node, operators) : nullptr;
+    auto slotOf = [&plan](const NodePtr& variable) {
+        return static_cast<size_t>(std::find(plan.variables.begin(), plan.variables.end(), variable->getName()) -
+                                   plan.variables.begin());
+    };
+    // Value of a subtree without variables; false if it fails
+    auto constantOf = [&evaluator](const NodePtr& subtree, double& value) {
+        ExpressionEvaluator::Value result;
+        const double* noVariables = nullptr;
+        bool succeeded = CompiledExpression(evaluator, ExpressionTree(subtree)).evaluate(noVariables, result) ==
+                         ExpressionError::NONE;
+        value = result.toDouble();
+        return succeeded;
+    };
+
+    Step step{};
+    if (node && !hasVariables(node)) {
+        step.kind = Step::CONSTANT;
+        step.mayFail = !constantOf(node, step.constant);
+    } else if (node && node->isVariable()) {
+        // A bare variable is true when nonzero
+        step.kind = Step::COMPARE;
+        step.comparison = OperatorDescriptor::NOT_EQUAL;
+        step.left = slotOf(node);
+        step.againstConstant = true;
+        step.constant = 0;
+    } else if (op && op->id == OperatorDescriptor::LOGICAL_NOT) {
+        step.kind = Step::NOT;
+        step.children.push_back(planNode(node->getRight(), evaluator, plan));
+    } else if (op && (op->id == OperatorDescriptor::LOGICAL_AND || op->id == OperatorDescriptor::LOGICAL_OR)) {
+        step.kind = (op->id == OperatorDescriptor::LOGICAL_AND) ? Step::ALL_OF : Step::ANY_OF;
+        std::vector<NodePtr> operands;
+        flatten(node, op->id, operators, operands);
+        for (const NodePtr& operand : operands) {
+            step.children.push_back(planNode(operand, evaluator, plan));
+        }
+        step.orderOffset = plan.order.size();
+        for (size_t i = 0; i < step.children.size(); ++i) {
+            plan.order.push_back(static_cast<int>(i));
+        }
+    } else {
+        step.kind = Step::GENERIC;
+        if (op && op->category == OperatorDescriptor::COMPARISON && !node->isUnaryOp() && node->getLeft() &&
+            node->getRight()) {
+            // Column against column, or column against a constant on either side
+            NodePtr left = node->getLeft(), right = node->getRight();
+            int comparison = op->id;
+            if (!left->isVariable()) {
+                std::swap(left, right);
+                comparison = mirrored(comparison);
+            }
+            if (left->isVariable() && (right->isVariable() || !hasVariables(right))) {
+                step.kind = Step::COMPARE;
+                step.comparison = comparison;
+                step.left = slotOf(left);
+                step.againstConstant = !right->isVariable();
+                if (step.againstConstant && !constantOf(right, step.constant)) {
+                    step.kind = Step::GENERIC;
+                } else if (!step.againstConstant) {
+                    step.right = slotOf(right);
+                }
+            }
+        }
+        if (step.kind == Step::GENERIC) {
+            step.mayFail = mayFail(node, operators);
+            step.expression = CompiledExpression(evaluator, ExpressionTree(node));
+            for (const std::string& name : step.expression.getVariables()) {
+                step.slots.push_back(std::find(plan.variables.begin(), plan.variables.end(), name) -
+                                     plan.variables.begin());
+            }
+        }
+    }
+
+    for (int child : step.children) {
+        step.mayFail = step.mayFail || plan.steps[child].mayFail;
+    }
+    step.text = ExpressionTree(node).inOrderTraversal();
+    plan.steps.push_back(std::move(step));
+    return static_cast<int>(plan.steps.size()) - 1;
+}
+
+// Evaluate one step over a chunk
+void ExpressionFilter::run(const Step& step, Context& context, size_t base, size_t rows,
+                           const uint64_t* candidates, uint64_t* result, uint64_t* failed) const {
+    const size_t words = (rows + 63) / 64;
+
+    switch (step.kind) {
+    case Step::ALL_OF:
+    case Step::ANY_OF: {
+        // A && operand only sees the rows that passed the previous ones, a ||
+        // operand only the rows no previous one matched; operands that can
+        // fail see every candidate, as their errors must be reported
+        const bool conjunction = (step.kind == Step::ALL_OF);
+        uint64_t narrowed[CHUNK_WORDS], matched[CHUNK_WORDS];
+        if (conjunction) {
+            std::copy(candidates, candidates + words, result);
+        } else {
+            std::fill(result, result + words, 0);
+        }
+        for (size_t i = 0; i < step.children.size(); ++i) {
+            int child = step.children[context.order[step.orderOffset + i]];
+            const Step& operand = plan->steps[child];
+            for (size_t w = 0; w < words; ++w) {
+                uint64_t pending = conjunction ? result[w] : candidates[w] & ~result[w];
+                narrowed[w] = (operand.mayFail ? candidates[w] : pending) & ~failed[w];
+            }
+
+            if (context.sampling) {
+                auto start = std::chrono::steady_clock::now();
+                run(operand, context, base, rows, narrowed, matched, failed);
+                auto elapsed = std::chrono::steady_clock::now() - start;
+                uint64_t evaluated = 0, passed = 0;
+                for (size_t w = 0; w < words; ++w) {
+                    evaluated += __builtin_popcountll(narrowed[w]);
+                    passed += __builtin_popcountll(matched[w] & ~failed[w]);
+                }
+                Counters& counters = adaptive->counters[child];
+                counters.rows.fetch_add(evaluated, std::memory_order_relaxed);
+                counters.passed.fetch_add(passed, std::memory_order_relaxed);
+                counters.nanoseconds.fetch_add(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count(), std::memory_order_relaxed);
+            } else {
+                run(operand, context, base, rows, narrowed, matched, failed);
+            }
+
+            for (size_t w = 0; w < words; ++w) {
+                result[w] = conjunction ? result[w] & matched[w] : result[w] | matched[w];
+            }
+        }
+        break;
+    }
+    case Step::NOT: {
+        uint64_t matched[CHUNK_WORDS];
+        run(plan->steps[step.children[0]], context, base, rows, candidates, matched, failed);
+        for (size_t w = 0; w < words; ++w) {
+            result[w] = candidates[w] & ~matched[w];
+        }
+        break;
+    }
+    case Step::CONSTANT:
+        for (size_t w = 0; w < words; ++w) {
+            if (step.mayFail) failed[w] |= candidates[w];
+            result[w] = (!step.mayFail && step.constant != 0) ? candidates[w] : 0;
+        }
+        break;
+    case Step::COMPARE: {
+        const double* left = context.columns[step.left] + base;
+        const double* right = step.againstConstant ? nullptr : context.columns[step.right] + base;
+        for (size_t w = 0; w < words; ++w) {
+            uint64_t mask = candidates[w];
+            if (mask == 0) {
+                result[w] = 0;
+            } else if (__builtin_popcountll(mask) <= SPARSE_WORD) {
+                // Few survivors: compare just those rows
+                uint64_t matched = 0;
+                for (uint64_t bits = mask; bits; bits &= bits - 1) {
+                    size_t row = 64 * w + __builtin_ctzll(bits);
+                    if (compareValues(step.comparison, left[row], right ? right[row] : step.constant)) {
+                        matched |= bits & -bits;
+                    }
+                }
+                result[w] = matched;
+            } else {
+                size_t count = std::min<size_t>(64, rows - 64 * w);
+                result[w] = mask & compareWord(step.comparison, left + 64 * w, right ? right + 64 * w : nullptr,
+                                               step.constant, count);
+            }
+        }
+        break;
+    }
+    case Step::GENERIC: {
+        thread_local std::vector<double> values;
+        values.resize(step.slots.size());
+        for (size_t w = 0; w < words; ++w) {
+            uint64_t matched = 0;
+            for (uint64_t bits = candidates[w]; bits; bits &= bits - 1) {
+                size_t row = base + 64 * w + __builtin_ctzll(bits);
+                for (size_t i = 0; i < step.slots.size(); ++i) {
+                    values[i] = context.columns[step.slots[i]][row];
+                }
+                ExpressionEvaluator::Value value;
+                if (step.expression.evaluate(values.data(), value) != ExpressionError::NONE) {
+                    failed[w] |= bits & -bits;
+                } else if (value.toDouble() != 0) {
+                    matched |= bits & -bits;
+                }
+            }
+            result[w] = matched;
+        }
+        break;
+    }
+    }
+}
+
+// Evaluate the predicate chunk by chunk into a bitmap
+size_t ExpressionFilter::filter(const double* const* columns, size_t rowCount, std::vector<uint64_t>& bitmap) const {
+    bitmap.assign((rowCount + 63) / 64, 0);
+    const Step& root = plan->steps[plan->root];
+    uint64_t candidates[CHUNK_WORDS], result[CHUNK_WORDS], failed[CHUNK_WORDS];
+    size_t matches = 0;
+
+    Context context;
+    context.columns = columns;
+    context.version = ~uint64_t(0);
+
+    for (size_t base = 0; base < rowCount; base += CHUNK_ROWS) {
+        size_t rows = std::min(CHUNK_ROWS, rowCount - base);
+        size_t words = (rows + 63) / 64;
+        std::fill(candidates, candidates + words, ~uint64_t(0));
+        std::fill(failed, failed + words, 0);
+        if (rows % 64 != 0) {
+            candidates[words - 1] = (uint64_t(1) << (rows % 64)) - 1;
+        }
+
+        // Pick up operand orders published since the last chunk
+        if (context.version != adaptive->version.load(std::memory_order_acquire)) {
+            std::lock_guard<std::mutex> lock(adaptive->mutex);
+            context.order = adaptive->order;
+            context.version = adaptive->version.load(std::memory_order_relaxed);
+        }
+        uint64_t chunk = adaptive->chunks.fetch_add(1, std::memory_order_relaxed);
+        context.sampling = (chunk % SAMPLE_PERIOD == 0);
+
+        run(root, context, base, rows, candidates, result, failed);
+        for (size_t w = 0; w < words; ++w) {
+            uint64_t matched = result[w] & ~failed[w];
+            bitmap[base / 64 + w] = matched;
+            matches += __builtin_popcountll(matched);
+        }
+        if ((chunk + 1) % REORDER_PERIOD == 0) {
+            reorder();
+        }
+    }
+    return matches;
+}
+
+// Sort the operands of each chain by expected work per candidate row. For
+// && an operand costing c that passes a fraction p of its rows should run
+// early when c / (1 - p) is small; for || when c / p is small. Operands
+// that can fail cost the same anywhere, so they go first; operands without
+// samples (nothing reached them) keep their place at the end. The counters
+// are halved afterwards, so the order follows changes in the data.
+void ExpressionFilter::reorder() const {
+    std::lock_guard<std::mutex> lock(adaptive->mutex);
+    bool changed = false;
+
+    for (const Step& step : plan->steps) {
+        if (step.kind != Step::ALL_OF && step.kind != Step::ANY_OF) continue;
+
+        std::vector<double> rank(step.children.size());
+        for (size_t i = 0; i < step.children.size(); ++i) {
+            const Step& operand = plan->steps[step.children[i]];
+            const Counters& counters = adaptive->counters[step.children[i]];
+            double rows = static_cast<double>(counters.rows.load(std::memory_order_relaxed));
+            if (operand.mayFail) {
+                rank[i] = 0;
+            } else if (rows == 0) {
+                rank[i] = std::numeric_limits<double>::infinity();
+            } else {
+                double cost = counters.nanoseconds.load(std::memory_order_relaxed) / rows;
+                double passRate = counters.passed.load(std::memory_order_relaxed) / rows;
+                double decisive = (step.kind == Step::ALL_OF) ? 1 - passRate : passRate;
+                rank[i] = cost / std::max(decisive, 1e-6);
+            }
+        }
+
+        auto first = adaptive->order.begin() + step.orderOffset;
+        auto last = first + step.children.size();
+        std::vector<int> previous(first, last);
+        std::stable_sort(first, last, [&rank](int a, int b) { return rank[a] < rank[b]; });
+        changed = changed || !std::equal(first, last, previous.begin());
+    }
+
+    for (size_t i = 0; i < plan->steps.size(); ++i) {
+        Counters& counters = adaptive->counters[i];
+        counters.rows.store(counters.rows.load(std::memory_order_relaxed) / 2, std::memory_order_relaxed);
+        counters.passed.store(counters.passed.load(std::memory_order_relaxed) / 2, std::memory_order_relaxed);
+        counters.nanoseconds.store(counters.nanoseconds.load(std::memory_order_relaxed) / 2,
+                                   std::memory_order_relaxed);
+    }
+    if (changed) {
+        ++adaptive->reorders;
+        adaptive->version.fetch_add(1, std::memory_order_release);
+    }
+}
+
+// Snapshot of the sampled statistics, chains in plan order
+ExpressionFilter::Stats ExpressionFilter::getStats() const {
+    std::lock_guard<std::mutex> lock(adaptive->mutex);
+    Stats stats;
+    stats.chunks = adaptive->chunks.load(std::memory_order_relaxed);
+    stats.reorders = adaptive->reorders;
+
+    for (const Step& step : plan->steps) {
+        if (step.kind != Step::ALL_OF && step.kind != Step::ANY_OF) continue;
+
+        ChainStats chain;
+        chain.op = (step.kind == Step::ALL_OF) ? "&&" : "||";
+        for (size_t i = 0; i < step.children.size(); ++i) {
+            int child = step.children[adaptive->order[step.orderOffset + i]];
+            const Counters& counters = adaptive->counters[child];
+            OperandStats operand;
+            operand.expression = plan->steps[child].text;
+            operand.rows = counters.rows.load(std::memory_order_relaxed);
+            double rows = std::max<double>(1, operand.rows);
+            operand.passRate = counters.passed.load(std::memory_order_relaxed) / rows;
+            operand.nanosecondsPerRow = counters.nanoseconds.load(std::memory_order_relaxed) / rows;
+            chain.operands.push_back(operand);
+        }
+        stats.chains.push_back(chain);
+    }
+    return stats;
+}
+
+// Evaluate the predicate into a selection vector
+size_t ExpressionFilter::select(const double* const* columns, size_t rowCount, std::vector<size_t>& selection) const {
+    thread_local std::vector<uint64_t> bitmap;
+    size_t matches = filter(columns, rowCount, bitmap);
+
+    selection.clear();
+    selection.reserve(matches);
+    for (size_t w = 0; w < bitmap.size(); ++w) {
+        for (uint64_t bits = bitmap[w]; bits; bits &= bits - 1) {
+            selection.push_back(64 * w + __builtin_ctzll(bits));
+        }
+    }
+    return matches;
+}
@@ -0,0 +1,162 @@
+#ifndef EXPRESSION_FILTER_HPP
+#define EXPRESSION_FILTER_HPP
+
+#include "CompiledExpression.hpp"
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * A predicate evaluated over columnar input, producing the matching rows as
+ * a bitmap or a selection vector instead of one 1.0/0.0 result per row
+ *
+ * The predicate is planned once: comparisons of a variable with a constant or
+ * another variable become SIMD compare-and-mask kernels, && / || chains are
+ * flattened, and any other subexpression falls back to a CompiledExpression
+ * evaluated per row. Rows are processed in chunks of CHUNK_ROWS; each
+ * conjunct of && runs only on the rows that survived the earlier ones (and
+ * each operand of || only on rows not yet matched), skipping empty 64-row
+ * words entirely.
+ *
+ * A row matches when evaluating the predicate with CompiledExpression would
+ * succeed with a nonzero result. Operands that can fail (division, modulo,
+ * bitwise operators) are evaluated on every candidate row, so rows are
+ * excluded on error exactly as in row-at-a-time evaluation.
+ *
+ * The order of && / || operands adapts to the data: every SAMPLE_PERIOD-th
+ * chunk is timed per operand, and every REORDER_PERIOD chunks the operands of
+ * each chain are re-sorted so the cheapest, most decisive checks run first
+ * (ascending cost / (1 - pass rate) for &&, cost / pass rate for ||).
+ * Operands that can fail run on every candidate row wherever they are, so
+ * they go first. Reordering never changes which rows match; getStats()
+ * reports the current order and the sampled rates.
+ *
+ * Like CompiledExpression the plan is immutable and may be shared by threads;
+ * copies and threads also share the sampled statistics and operand order.
+ */
+class ExpressionFilter {
+public:
+    // Plan a predicate with the operators of evaluator; throws ExpressionError
+    ExpressionFilter(const ExpressionEvaluator& evaluator, const std::string& predicate);
+    ExpressionFilter(const ExpressionEvaluator& evaluator, const ExpressionTree& tree);
+
+    // Variable names in order of first appearance (as in CompiledExpression);
+    // columns are passed in the same order
+    const std::vector<std::string>& getVariables() const { return plan->variables; }
+
+    // Set bit r of bitmap (resized to (rowCount + 63) / 64 words) for every
+    // matching row r; columns[i] holds rowCount values of variable i.
+    // Returns the number of matching rows.
+    size_t filter(const double* const* columns, size_t rowCount, std::vector<uint64_t>& bitmap) const;
+
+    // Replace selection with the indices of the matching rows, in order
+    size_t select(const double* const* columns, size_t rowCount, std::vector<size_t>& selection) const;
+
+    // Sampled statistics of one operand of a && / || chain
+    struct OperandStats {
+        std::string expression;     // Operand in infix form
+        uint64_t rows;              // Sampled rows it was evaluated on (decays at each reorder)
+        double passRate;            // Fraction of those rows on which it was true
+        double nanosecondsPerRow;
+    };
+
+    // A && / || chain with its operands in current evaluation order
+    struct ChainStats {
+        std::string op;             // "&&" or "||"
+        std::vector<OperandStats> operands;
+    };
+
+    struct Stats {
+        std::vector<ChainStats> chains;     // Innermost chains first
+        uint64_t chunks;                    // Chunks filtered so far
+        uint64_t reorders;                  // Times an operand order changed
+    };
+
+    // Snapshot of the statistics and the current operand orders
+    Stats getStats() const;
+
+    // Rows processed at a time; a multiple of 64
+    static constexpr size_t CHUNK_ROWS = 2048;
+
+    // Chunks between timed chunks, and between reorderings
+    static const uint64_t SAMPLE_PERIOD = 8;
+    static const uint64_t REORDER_PERIOD = 64;
+
+private:
+    static constexpr size_t CHUNK_WORDS = CHUNK_ROWS / 64;
+
+    struct Step {
+        enum Kind {
+            ALL_OF,     // Conjunction of children (&&, and)
+            ANY_OF,     // Disjunction of children (||, or)
+            NOT,        // Negation of children[0]
+            COMPARE,    // Column compared with a constant or another column
+            CONSTANT,   // Subexpression without variables, evaluated when planned
+            GENERIC     // Any other subexpression, evaluated per row
+        };
+        Kind kind;
+        bool mayFail;                   // Some row may fail to evaluate
+        std::vector<int> children;      // Step indices, as written
+        size_t orderOffset;             // ALL_OF, ANY_OF: position of the children's order in Adaptive::order
+        std::string text;               // Infix form of the subtree
+        int comparison;                 // COMPARE: OperatorDescriptor::Id
+        size_t left, right;             // COMPARE: column slots; right unused against a constant
+        bool againstConstant;
+        double constant;                // COMPARE: right operand; CONSTANT: value
+        CompiledExpression expression;  // GENERIC
+        std::vector<size_t> slots;      // GENERIC: column of each variable of expression
+    };
+
+    struct Plan {
+        std::vector<Step> steps;
+        std::vector<std::string> variables;
+        std::vector<int> order;         // Initial chain orders, as written
+        int root = -1;
+    };
+
+    // Sampled totals of one step (relaxed atomics: threads add concurrently)
+    struct Counters {
+        std::atomic<uint64_t> rows{0};
+        std::atomic<uint64_t> passed{0};
+        std::atomic<uint64_t> nanoseconds{0};
+    };
+
+    // Runtime state shared by all users of a plan
+    struct Adaptive {
+        std::unique_ptr<Counters[]> counters;   // Per step
+        std::atomic<uint64_t> chunks{0};
+        std::atomic<uint64_t> version{0};       // Incremented when order changes
+        std::mutex mutex;                       // Guards order and reorders
+        std::vector<int> order;                 // Per chain: child positions in evaluation order
+        uint64_t reorders = 0;
+    };
+
+    // State of one filter() call
+    struct Context {
+        const double* const* columns;
+        std::vector<int> order;                 // This call's copy of Adaptive::order
+        uint64_t version;
+        bool sampling;                          // Time the chain operands of this chunk
+    };
+
+    // Append the steps of a subtree; returns its step index
+    static int planNode(NodePtr node, const ExpressionEvaluator& evaluator, Plan& plan);
+
+    // Evaluate a step on the candidate rows of the rows-long chunk starting at
+    // row base. Sets the matching candidates in result and failing rows in
+    // failed; result bits of failed rows are unspecified.
+    void run(const Step& step, Context& context, size_t base, size_t rows,
+             const uint64_t* candidates, uint64_t* result, uint64_t* failed) const;
+
+    // Re-sort the operands of every chain by their sampled cost and pass rate
+    void reorder() const;
+
+    std::shared_ptr<const Plan> plan;
+    std::shared_ptr<Adaptive> adaptive;
+};
+
+#endif // EXPRESSION_FILTER_HPP
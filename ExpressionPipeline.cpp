@@ -0,0 +1,196 @@
+#include "ExpressionPipeline.hpp"
+#include <iomanip>
+#include <chrono>
+#include <map>
+#include <thread>
+#include <algorithm>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+long long elapsedNanoseconds(Clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+}
+
+// Pop a batch, accounting the wait as starvation
+template <typename Queue, typename Item, typename Metrics>
+bool timedPop(Queue& queue, Item& item, Metrics& metrics) {
+    auto start = Clock::now();
+    bool ok = queue.pop(item);
+    metrics.starvedNanoseconds += elapsedNanoseconds(start);
+    return ok;
+}
+
+// Push a batch, accounting the wait as backpressure
+template <typename Queue, typename Item, typename Metrics>
+void timedPush(Queue& queue, Item item, Metrics& metrics) {
+    auto start = Clock::now();
+    queue.push(std::move(item));
+    metrics.blockedNanoseconds += elapsedNanoseconds(start);
+}
+
+} // namespace
+
+ExpressionPipeline::ExpressionPipeline(const Options& options)
+    : options(options), parseQueue(options.queueCapacity), evaluateQueue(options.queueCapacity),
+      writeQueue(options.queueCapacity), credits(options.queueCapacity), activeParsers(0), activeEvaluators(0),
+      wallSeconds(0), maxHeldBack(0) {
+    this->options.batchSize = std::max<size_t>(1, options.batchSize);
+    this->options.queueCapacity = std::max<size_t>(1, options.queueCapacity);
+    this->options.parserThreads = std::max<size_t>(1, options.parserThreads);
+    this->options.evaluatorThreads = std::max<size_t>(1, options.evaluatorThreads);
+    for (size_t i = 0; i < this->options.queueCapacity; ++i) {
+        credits.push(true);
+    }
+    readMetrics.name = "reader";
+    parseMetrics.name = "parser";
+    evaluateMetrics.name = "evaluator";
+    writeMetrics.name = "writer";
+}
+
+// Process every line of input and write one result line per input line
+void ExpressionPipeline::run(std::istream& input, std::ostream& output) {
+    auto start = Clock::now();
+    activeParsers = options.parserThreads;
+    activeEvaluators = options.evaluatorThreads;
+    readMetrics.threads = 1;
+    parseMetrics.threads = options.parserThreads;
+    evaluateMetrics.threads = options.evaluatorThreads;
+    writeMetrics.threads = 1;
+    maxHeldBack = 0;
+    
+    std::vector<std::thread> threads;
+    threads.emplace_back(&ExpressionPipeline::readStage, this, std::ref(input));
+    for (size_t i = 0; i < options.parserThreads; ++i) {
+        threads.emplace_back(&ExpressionPipeline::parseStage, this);
+    }
+    for (size_t i = 0; i < options.evaluatorThreads; ++i) {
+        threads.emplace_back(&ExpressionPipeline::evaluateStage, this);
+    }
+    writeStage(output);
+    
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    wallSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Read lines into batches
+void ExpressionPipeline::readStage(std::istream& input) {
+    size_t sequence = 0;
+    bool more = true;
+    
+    while (more) {
+        auto start = Clock::now();
+        BatchPtr batch(new Batch());
+        batch->sequence = sequence++;
+        batch->lines.reserve(options.batchSize);
+        
+        std::string line;
+        while (batch->lines.size() < options.batchSize && (more = static_cast<bool>(std::getline(input, line)))) {
+            batch->lines.push_back(std::move(line));
+        }
+        readMetrics.lines += batch->lines.size();
+        readMetrics.busyNanoseconds += elapsedNanoseconds(start);
+        
+        if (!batch->lines.empty()) {
+            bool credit;
+            start = Clock::now();
+            credits.pop(credit);
+            readMetrics.blockedNanoseconds += elapsedNanoseconds(start);
+            timedPush(parseQueue, std::move(batch), readMetrics);
+        }
+    }
+    parseQueue.close();
+}
+
+// Build the expression tree of every line; parse errors are kept per line
+void ExpressionPipeline::parseStage() {
+    BatchPtr batch;
+    
+    while (timedPop(parseQueue, batch, parseMetrics)) {
+        auto start = Clock::now();
+        batch->trees.resize(batch->lines.size());
+        batch->errors.resize(batch->lines.size(), ExpressionError::NONE);
+        
+        for (size_t i = 0; i < batch->lines.size(); ++i) {
+            if (batch->lines[i].empty()) continue;
+            batch->errors[i] = evaluator.tryBuildExpressionTree(batch->lines[i], batch->trees[i]);
+        }
+        parseMetrics.lines += batch->lines.size();
+        parseMetrics.busyNanoseconds += elapsedNanoseconds(start);
+        timedPush(evaluateQueue, std::move(batch), parseMetrics);
+    }
+    
+    if (--activeParsers == 0) evaluateQueue.close();
+}
+
+// Evaluate the parsed trees and format one output line per input line
+void ExpressionPipeline::evaluateStage() {
+    BatchPtr batch;
+    ExpressionEvaluator::Value value;
+    
+    while (timedPop(evaluateQueue, batch, evaluateMetrics)) {
+        auto start = Clock::now();
+        for (size_t i = 0; i < batch->lines.size(); ++i) {
+            ExpressionError::Code error = batch->errors[i];
+            if (error == ExpressionError::NONE && batch->trees[i].getRoot()) {
+                error = evaluator.tryEvaluate(batch->trees[i], value);
+                if (error == ExpressionError::NONE) {
+                    batch->output += ExpressionEvaluator::formatResult(value);
+                }
+            }
+            if (error != ExpressionError::NONE) {
+                batch->output += ExpressionError::message(error);
+            }
+            batch->output += '\n';
+        }
+        batch->trees.clear();
+        evaluateMetrics.lines += batch->lines.size();
+        evaluateMetrics.busyNanoseconds += elapsedNanoseconds(start);
+        timedPush(writeQueue, std::move(batch), evaluateMetrics);
+    }
+    
+    if (--activeEvaluators == 0) writeQueue.close();
+}
+
+// Write batches in input order, holding back any that arrive early. Each
+// written batch returns its credit to the reader.
+void ExpressionPipeline::writeStage(std::ostream& output) {
+    std::map<size_t, BatchPtr> pending;
+    size_t nextSequence = 0;
+    BatchPtr batch;
+    
+    while (timedPop(writeQueue, batch, writeMetrics)) {
+        auto start = Clock::now();
+        pending[batch->sequence] = std::move(batch);
+        
+        for (auto it = pending.begin(); it != pending.end() && it->first == nextSequence;
+             it = pending.erase(it), ++nextSequence) {
+            output << it->second->output;
+            writeMetrics.lines += it->second->lines.size();
+            credits.push(true);
+        }
+        maxHeldBack = std::max(maxHeldBack, pending.size());
+        writeMetrics.busyNanoseconds += elapsedNanoseconds(start);
+    }
+    output.flush();
+}
+
+// Print the per-stage utilization of the last run
+void ExpressionPipeline::printMetrics(std::ostream& out) const {
+    out << "Pipeline: " << writeMetrics.lines << " lines in " << std::fixed << std::setprecision(3)
+        << wallSeconds << " s" << std::endl;
+    out << "  stage      threads  busy%  starved%  blocked%" << std::endl;
+    
+    for (const StageMetrics* stage : {&readMetrics, &parseMetrics, &evaluateMetrics, &writeMetrics}) {
+        double capacity = wallSeconds * 1e9 * std::max<size_t>(1, stage->threads);
+        out << "  " << std::left << std::setw(10) << stage->name << std::right
+            << std::setw(8) << stage->threads
+            << std::setw(7) << std::setprecision(1) << 100.0 * stage->busyNanoseconds / capacity
+            << std::setw(10) << 100.0 * stage->starvedNanoseconds / capacity
+            << std::setw(10) << 100.0 * stage->blockedNanoseconds / capacity << std::endl;
+    }
+    out << "  writer held back at most " << maxHeldBack << " batches" << std::endl;
+}
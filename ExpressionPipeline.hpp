@@ -0,0 +1,96 @@
+#ifndef EXPRESSION_PIPELINE_HPP
+#define EXPRESSION_PIPELINE_HPP
+
+#include "ExpressionEvaluator.hpp"
+#include "RingBuffer.hpp"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <cstddef>
+
+/**
+ * Staged batch evaluator: reader -> parser -> evaluator -> writer
+ *
+ * Every stage runs on its own thread(s) and the stages are connected by
+ * bounded lock-free ring buffers carrying batches of lines, so reading,
+ * parsing, evaluation and output overlap. Full buffers block the upstream
+ * stage (backpressure). The writer restores input order, producing exactly
+ * one output line per input line. Batches finished out of order wait in the
+ * writer, so the reader also takes a credit per batch, which the writer
+ * returns once the batch is written: at most queueCapacity batches are past
+ * the reader, however long one slow batch holds back the ones after it.
+ */
+class ExpressionPipeline {
+public:
+    struct Options {
+        size_t batchSize = 256;         // Lines per batch
+        size_t queueCapacity = 64;      // Batches per ring buffer, and in flight
+        size_t parserThreads = 1;
+        size_t evaluatorThreads = 1;
+    };
+
+    // Per-stage counters, reported after run()
+    struct StageMetrics {
+        std::string name;
+        size_t threads = 0;
+        std::atomic<size_t> lines{0};
+        std::atomic<long long> busyNanoseconds{0};      // Doing the stage's own work
+        std::atomic<long long> starvedNanoseconds{0};   // Waiting for input
+        std::atomic<long long> blockedNanoseconds{0};   // Waiting for space downstream
+    };
+
+    explicit ExpressionPipeline(const Options& options);
+
+    // Process every line of input and write one result line per input line
+    void run(std::istream& input, std::ostream& output);
+
+    // Print the per-stage utilization of the last run
+    void printMetrics(std::ostream& out) const;
+
+    // Most batches the writer held back waiting for an earlier one in the last run
+    size_t getMaxHeldBack() const { return maxHeldBack; }
+
+private:
+    struct Batch {
+        size_t sequence;
+        std::vector<std::string> lines;
+        std::vector<ExpressionTree> trees;
+        std::vector<ExpressionError::Code> errors;  // Parse error of each line
+        std::string output;                         // Formatted results of the batch
+    };
+    using BatchPtr = std::unique_ptr<Batch>;
+
+    void readStage(std::istream& input);
+    void parseStage();
+    void evaluateStage();
+    void writeStage(std::ostream& output);
+
+    Options options;
+    
+    // Shared by every parser and evaluator thread; its parsing and
+    // evaluation methods are const and touch no mutable state
+    const ExpressionEvaluator evaluator;
+    
+    RingBuffer<BatchPtr> parseQueue;
+    RingBuffer<BatchPtr> evaluateQueue;
+    RingBuffer<BatchPtr> writeQueue;
+    
+    // One token per batch allowed in flight; the reader takes one before
+    // sending a batch, the writer gives it back after writing the batch
+    RingBuffer<bool> credits;
+
+    // Threads of a stage still running; the last one closes the next queue
+    std::atomic<size_t> activeParsers;
+    std::atomic<size_t> activeEvaluators;
+
+    StageMetrics readMetrics;
+    StageMetrics parseMetrics;
+    StageMetrics evaluateMetrics;
+    StageMetrics writeMetrics;
+    double wallSeconds;
+    size_t maxHeldBack;
+};
+
+#endif // EXPRESSION_PIPELINE_HPP
@@ -0,0 +1,144 @@
+#include "ExpressionProfile.hpp"
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+namespace {
+
+// Label of a node as displayTree prints it
+std::string label(const Node& node) {
+    std::ostringstream ss;
+    if (node.isOperand()) {
+        ss << node.getValue();
+    } else if (node.isVariable()) {
+        ss << node.getName();
+    } else {
+        ss << node.getOperator();
+    }
+    return ss.str();
+}
+
+const char* kind(const Node& node) {
+    switch (node.getType()) {
+    case Node::OPERAND:  return "operand";
+    case Node::VARIABLE: return "variable";
+    case Node::UNARY_OP: return "unary";
+    default:             return "operator";
+    }
+}
+
+// Quote a string for JSON
+std::string quoted(const std::string& text) {
+    std::string result = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') result += '\\';
+        result += c;
+    }
+    return result + "\"";
+}
+
+} // namespace
+
+ExpressionProfile::ExpressionProfile(const ExpressionTree& tree)
+    : tree(tree), evaluations(0), errorAttributed(false) {
+}
+
+// Statistics of a node
+const ExpressionProfile::NodeStats& ExpressionProfile::getStats(const Node* node) const {
+    static const NodeStats none;
+    auto it = stats.find(node);
+    return it != stats.end() ? it->second : none;
+}
+
+// Start a profiled evaluation
+void ExpressionProfile::begin() {
+    ++evaluations;
+    errorAttributed = false;
+}
+
+// Children finish first, so the first node to finish with an error is the
+// one that raised it (a missing child is charged to its parent)
+void ExpressionProfile::record(const Node* node, Clock::duration elapsed, ExpressionError::Code error) {
+    if (!node) return;
+    NodeStats& counters = stats[node];
+    ++counters.invocations;
+    counters.nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+    if (error != ExpressionError::NONE && !errorAttributed) {
+        ++counters.errors;
+        errorAttributed = true;
+    }
+}
+
+// Count a skip of the right operand when the left one decides the && / ||
+void ExpressionProfile::shortCircuit(const OperatorDescriptor& op, double left, const Node& node) {
+    bool decided = (op.id == OperatorDescriptor::LOGICAL_AND && left == 0) ||
+                   (op.id == OperatorDescriptor::LOGICAL_OR && left != 0);
+    if (decided && node.getRight()) {
+        ++stats[node.getRight().get()].skips;
+    }
+}
+
+// Display the annotated tree
+void ExpressionProfile::display(std::ostream& out) const {
+    out << "Profile of " << evaluations << " evaluation(s)\n";
+    tree.displayTree(out, [this](const Node& node) {
+        const NodeStats& counters = getStats(&node);
+        std::ostringstream ss;
+        ss << std::fixed << std::setprecision(3) << "  (calls " << counters.invocations << ", "
+           << counters.nanoseconds / 1e6 << " ms";
+        if (counters.invocations > 0) {
+            ss << std::setprecision(0) << ", " << double(counters.nanoseconds) / counters.invocations << " ns/call";
+        }
+        if (counters.skips > 0) ss << ", skips " << counters.skips;
+        if (counters.errors > 0) ss << ", errors " << counters.errors;
+        ss << ")";
+        return ss.str();
+    });
+}
+
+// JSON report
+std::string ExpressionProfile::toJson() const {
+    std::string json = "{\n  \"evaluations\": " + std::to_string(evaluations) + ",\n  \"root\": ";
+    if (tree.getRoot()) {
+        appendJson(tree.getRoot(), json, 2);
+    } else {
+        json += "null";
+    }
+    return json + "\n}\n";
+}
+
+// Append one node object; self time excludes the children's time
+void ExpressionProfile::appendJson(const NodePtr& node, std::string& json, int indent) const {
+    const NodeStats& counters = getStats(node.get());
+    uint64_t childNanoseconds = 0;
+    for (const NodePtr& child : {node->getLeft(), node->getRight()}) {
+        if (child) childNanoseconds += getStats(child.get()).nanoseconds;
+    }
+    uint64_t selfNanoseconds = counters.nanoseconds - std::min(counters.nanoseconds, childNanoseconds);
+
+    std::string pad(indent + 2, ' ');
+    json += "{\n";
+    json += pad + "\"node\": " + quoted(label(*node)) + ",\n";
+    json += pad + "\"kind\": " + quoted(kind(*node)) + ",\n";
+    json += pad + "\"invocations\": " + std::to_string(counters.invocations) + ",\n";
+    json += pad + "\"nanoseconds\": " + std::to_string(counters.nanoseconds) + ",\n";
+    json += pad + "\"selfNanoseconds\": " + std::to_string(selfNanoseconds) + ",\n";
+    json += pad + "\"skips\": " + std::to_string(counters.skips) + ",\n";
+    json += pad + "\"errors\": " + std::to_string(counters.errors) + ",\n";
+    json += pad + "\"children\": [";
+    bool first = true;
+    for (const NodePtr& child : {node->getLeft(), node->getRight()}) {
+        if (!child) continue;
+        json += first ? "\n" + pad + "  " : ",\n" + pad + "  ";
+        appendJson(child, json, indent + 4);
+        first = false;
+    }
+    json += first ? "]\n" : "\n" + pad + "]\n";
+    json += std::string(indent, ' ') + "}";
+}
+
+// Forget all measurements
+void ExpressionProfile::reset() {
+    stats.clear();
+    evaluations = 0;
+}
@@ -0,0 +1,93 @@
+#ifndef EXPRESSION_PROFILE_HPP
+#define EXPRESSION_PROFILE_HPP
+
+#include "ExpressionTree.hpp"
+#include "OperatorRegistry.hpp"
+#include <string>
+#include <unordered_map>
+#include <chrono>
+#include <ostream>
+#include <cstdint>
+
+/**
+ * Per-node measurements over evaluations of one tree, in the manner of
+ * EXPLAIN ANALYZE
+ *
+ * Filled by ExpressionEvaluator::tryEvaluate(profile, result), which
+ * evaluates the tree the profile was constructed with. For
+ * every node it records how often it was evaluated, the time spent in it
+ * (including its children), how often its evaluation could have been
+ * skipped because the left operand of the enclosing && / || already
+ * decided the result (ExpressionFilter skips those; the tree evaluator
+ * evaluates both operands so errors surface), and how many errors were
+ * raised at the node itself rather than passed up from a child.
+ *
+ * Only the profiled overload pays for this: the evaluator is instantiated
+ * separately for it, and the plain overloads contain no profiling code.
+ * A profile is not thread-safe; use one per thread.
+ */
+class ExpressionProfile {
+public:
+    struct NodeStats {
+        uint64_t invocations = 0;
+        uint64_t nanoseconds = 0;       // Inclusive of children
+        uint64_t skips = 0;             // Short-circuit skips
+        uint64_t errors = 0;            // Errors raised at this node
+    };
+
+    explicit ExpressionProfile(const ExpressionTree& tree);
+
+    // Statistics of a node of the tree (all zero if it never ran)
+    const NodeStats& getStats(const Node* node) const;
+
+    // Number of profiled evaluations
+    uint64_t getEvaluations() const { return evaluations; }
+
+    // Print the tree as displayTree does, each node followed by its statistics
+    void display(std::ostream& out) const;
+
+    // The statistics as a JSON document: the evaluation count and the tree of
+    // nodes, each with its counters, self time and children (left, right)
+    std::string toJson() const;
+
+    // Forget all measurements
+    void reset();
+
+private:
+    friend class ExpressionEvaluator;
+    using Clock = std::chrono::steady_clock;
+
+    // Times one node evaluation and records it when it goes out of scope
+    class Scope {
+    public:
+        Scope(ExpressionProfile& profile, const Node* node, const ExpressionError::Code& error)
+            : profile(profile), node(node), error(error), start(Clock::now()) {}
+        ~Scope() { profile.record(node, Clock::now() - start, error); }
+
+    private:
+        ExpressionProfile& profile;
+        const Node* node;
+        const ExpressionError::Code& error;
+        Clock::time_point start;
+    };
+
+    // Called before each evaluation of the tree
+    void begin();
+
+    // Record one evaluation of a node ending with error
+    void record(const Node* node, Clock::duration elapsed, ExpressionError::Code error);
+
+    // Called after the left operand of a binary node was evaluated: counts a
+    // skip for its right operand if op is && / || and left decides the result
+    void shortCircuit(const OperatorDescriptor& op, double left, const Node& node);
+
+    // Write a node and its subtree as JSON
+    void appendJson(const NodePtr& node, std::string& json, int indent) const;
+
+    ExpressionTree tree;
+    std::unordered_map<const Node*, NodeStats> stats;
+    uint64_t evaluations;
+    bool errorAttributed;       // The current evaluation's error was counted
+};
+
+#endif // EXPRESSION_PROFILE_HPP
@@ -0,0 +1,340 @@
+#include "ExpressionServer.hpp"
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <cerrno>
+#include <system_error>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+namespace {
+
+// Seconds on a monotonic clock
+double now() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+[[noreturn]] void throwSystemError(const std::string& what) {
+    throw std::system_error(errno, std::generic_category(), what);
+}
+
+void setNonBlocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        throwSystemError("fcntl");
+    }
+}
+
+// Return the p-th percentile (0..1) of the samples, reordering them
+double percentile(std::vector<double>& samples, double p) {
+    if (samples.empty()) return 0;
+    size_t index = std::min(samples.size() - 1, static_cast<size_t>(p * samples.size()));
+    std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+    return samples[index];
+}
+
+} // namespace
+
+// Create the listening socket and the epoll instance
+ExpressionServer::ExpressionServer(const std::string& socketPath, size_t cacheCapacity)
+    : socketPath(socketPath), listenFd(-1), epollFd(-1), running(false),
+      cacheCapacity(std::max<size_t>(1, cacheCapacity)), cacheHits(0), statsStart(now()) {
+    sockaddr_un address{};
+    if (socketPath.length() >= sizeof(address.sun_path)) {
+        throw std::invalid_argument("Socket path too long: " + socketPath);
+    }
+    address.sun_family = AF_UNIX;
+    std::strcpy(address.sun_path, socketPath.c_str());
+
+    listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listenFd < 0) throwSystemError("socket");
+
+    unlink(socketPath.c_str()); // Remove a stale socket from a previous run
+    if (bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 ||
+        listen(listenFd, SOMAXCONN) < 0) {
+        close(listenFd);
+        throwSystemError("bind " + socketPath);
+    }
+    setNonBlocking(listenFd);
+
+    epollFd = epoll_create1(0);
+    if (epollFd < 0) throwSystemError("epoll_create1");
+
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = listenFd;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &event) < 0) throwSystemError("epoll_ctl");
+}
+
+// Close every descriptor and remove the socket file
+ExpressionServer::~ExpressionServer() {
+    for (const auto& connection : connections) {
+        close(connection.first);
+    }
+    if (epollFd >= 0) close(epollFd);
+    if (listenFd >= 0) close(listenFd);
+    unlink(socketPath.c_str());
+}
+
+// Serve clients until stop() is called
+void ExpressionServer::run(int reportSeconds) {
+    const int MAX_EVENTS = 64;
+    epoll_event events[MAX_EVENTS];
+    double lastReport = now();
+    running = true;
+
+    while (running) {
+        int count = epoll_wait(epollFd, events, MAX_EVENTS, 1000);
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            throwSystemError("epoll_wait");
+        }
+
+        for (int i = 0; i < count; ++i) {
+            int fd = events[i].data.fd;
+            if (fd == listenFd) {
+                acceptConnections();
+                continue;
+            }
+            if (events[i].events & EPOLLIN) {
+                handleReadable(fd);
+            } else if (events[i].events & (EPOLLHUP | EPOLLERR)) {
+                closeConnection(fd);
+                continue;
+            }
+            if (connections.count(fd) && (events[i].events & EPOLLOUT)) flushOutput(fd);
+        }
+
+        if (reportSeconds > 0 && now() - lastReport >= reportSeconds) {
+            lastReport = now();
+            Stats stats = takeStats();
+            if (stats.requests > 0) {
+                std::cout << std::fixed << std::setprecision(1)
+                          << "requests: " << stats.requests
+                          << "  req/s: " << stats.requestsPerSecond
+                          << "  p50: " << stats.p50Microseconds << " us"
+                          << "  p99: " << stats.p99Microseconds << " us"
+                          << "  cache hits: " << stats.cacheHits << std::endl;
+            }
+        }
+    }
+}
+
+// Collect and reset the statistics gathered since the previous call
+ExpressionServer::Stats ExpressionServer::takeStats() {
+    double end = now();
+    Stats stats;
+    stats.requests = latencySamples.size();
+    stats.cacheHits = cacheHits;
+    stats.requestsPerSecond = stats.requests / std::max(1e-9, end - statsStart);
+    stats.p50Microseconds = percentile(latencySamples, 0.50) * 1e6;
+    stats.p99Microseconds = percentile(latencySamples, 0.99) * 1e6;
+
+    latencySamples.clear();
+    cacheHits = 0;
+    statsStart = end;
+    return stats;
+}
+
+// Accept all pending connections on the listening socket
+void ExpressionServer::acceptConnections() {
+    while (true) {
+        int fd = accept(listenFd, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) return;
+            throwSystemError("accept");
+        }
+        setNonBlocking(fd);
+
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) < 0) {
+            close(fd);
+            continue;
+        }
+        connections[fd] = Connection();
+    }
+}
+
+// Read available data, evaluating the complete requests of each read, until
+// the socket is drained or too many responses are waiting for the client
+void ExpressionServer::handleReadable(int fd) {
+    Connection& connection = connections[fd];
+    char buffer[64 * 1024];
+    bool peerClosed = false;
+
+    while (connection.output.size() < MAX_PENDING_OUTPUT) {
+        ssize_t received = read(fd, buffer, sizeof(buffer));
+        if (received > 0) {
+            connection.input.append(buffer, received);
+            if (!evaluateRequests(connection, now())) {
+                closeConnection(fd);
+                return;
+            }
+        } else if (received == 0) {
+            peerClosed = true;
+            break;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            break;
+        } else if (errno != EINTR) {
+            closeConnection(fd);
+            return;
+        }
+    }
+
+    if (!connection.output.empty()) flushOutput(fd);
+    if (peerClosed && connections.count(fd)) closeConnection(fd);
+}
+
+// Evaluate every complete request in the input as one batch
+bool ExpressionServer::evaluateRequests(Connection& connection, double readTime) {
+    size_t offset = 0;
+    std::string expression;
+    while (connection.input.size() - offset >= sizeof(uint32_t)) {
+        uint32_t length;
+        std::memcpy(&length, connection.input.data() + offset, sizeof(length));
+        if (length > MAX_REQUEST_LENGTH) return false;
+        if (connection.input.size() - offset - sizeof(length) < length) break;
+
+        expression.assign(connection.input, offset + sizeof(length), length);
+        offset += sizeof(length) + length;
+        size_t before = connection.output.size();
+        evaluateRequest(expression, connection.output);
+        connection.queuedBytes += connection.output.size() - before;
+        connection.pending.emplace_back(connection.queuedBytes, readTime);
+    }
+    connection.input.erase(0, offset);
+    return true;
+}
+
+// Write as much pending output as the socket accepts, waiting for EPOLLOUT
+// only while the socket is full. Requests whose responses are now fully
+// written contribute their latency samples.
+void ExpressionServer::flushOutput(int fd) {
+    Connection& connection = connections[fd];
+    size_t written = 0;
+
+    while (written < connection.output.size()) {
+        ssize_t sent = send(fd, connection.output.data() + written,
+                            connection.output.size() - written, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            closeConnection(fd);
+            return;
+        }
+        written += sent;
+    }
+    connection.output.erase(0, written);
+
+    connection.sentBytes += written;
+    double sentTime = now();
+    while (!connection.pending.empty() && connection.pending.front().first <= connection.sentBytes) {
+        latencySamples.push_back(sentTime - connection.pending.front().second);
+        connection.pending.pop_front();
+    }
+    updateEvents(fd, connection);
+}
+
+// Stop reading a connection while its client is behind on responses
+void ExpressionServer::updateEvents(int fd, const Connection& connection) {
+    epoll_event event{};
+    event.events = 0;
+    if (connection.output.size() < MAX_PENDING_OUTPUT) event.events |= EPOLLIN;
+    if (!connection.output.empty()) event.events |= EPOLLOUT;
+    event.data.fd = fd;
+    epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &event);
+}
+
+void ExpressionServer::closeConnection(int fd) {
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+    close(fd);
+    connections.erase(fd);
+}
+
+// Evaluate one request, using the compiled expression cache. No variables
+// are bound, so any variable is reported as unknown.
+void ExpressionServer::evaluateRequest(const std::string& expression, std::string& out) {
+    ExpressionError::Code error = ExpressionError::NONE;
+    ExpressionEvaluator::Value result;
+    
+    const CompiledExpression* compiled = compile(expression, error);
+    if (compiled) {
+        const double* noVariables = nullptr;
+        error = compiled->evaluate(noVariables, result);
+    }
+    if (error == ExpressionError::NONE) {
+        encodeResponse(out, STATUS_OK, result.toDouble(), "");
+    } else {
+        encodeResponse(out, STATUS_ERROR, 0, ExpressionError::message(error));
+    }
+}
+
+// Look up a compiled expression, building and caching it on a miss. Only
+// the compiled program is kept; the parse tree is released right away.
+const CompiledExpression* ExpressionServer::compile(const std::string& expression, ExpressionError::Code& error) {
+    auto it = cache.find(expression);
+    if (it != cache.end()) {
+        ++cacheHits;
+        cacheOrder.splice(cacheOrder.begin(), cacheOrder, it->second);
+        return &it->second->second;
+    }
+
+    ExpressionTree tree;
+    error = evaluator.tryBuildExpressionTree(expression, tree);
+    if (error != ExpressionError::NONE) return nullptr;
+    if (cache.size() >= cacheCapacity) {
+        cache.erase(cacheOrder.back().first);
+        cacheOrder.pop_back();
+    }
+    cacheOrder.emplace_front(expression, CompiledExpression(evaluator, tree));
+    cache[expression] = cacheOrder.begin();
+    return &cacheOrder.front().second;
+}
+
+void ExpressionServer::encodeRequest(std::string& out, const std::string& expression) {
+    uint32_t length = static_cast<uint32_t>(expression.length());
+    out.append(reinterpret_cast<const char*>(&length), sizeof(length));
+    out += expression;
+}
+
+void ExpressionServer::encodeResponse(std::string& out, Status status, double value, const std::string& message) {
+    out += static_cast<char>(status);
+    if (status == STATUS_OK) {
+        out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    } else {
+        uint32_t length = static_cast<uint32_t>(message.length());
+        out.append(reinterpret_cast<const char*>(&length), sizeof(length));
+        out += message;
+    }
+}
+
+// Decode one response from data[offset, size); returns false if incomplete
+bool ExpressionServer::decodeResponse(const std::string& data, size_t& offset, Response& response) {
+    size_t available = data.size() - offset;
+    if (available < 1) return false;
+
+    Status status = static_cast<Status>(data[offset]);
+    if (status == STATUS_OK) {
+        if (available < 1 + sizeof(double)) return false;
+        std::memcpy(&response.value, data.data() + offset + 1, sizeof(double));
+        response.message.clear();
+        offset += 1 + sizeof(double);
+    } else {
+        uint32_t length;
+        if (available < 1 + sizeof(length)) return false;
+        std::memcpy(&length, data.data() + offset + 1, sizeof(length));
+        if (available < 1 + sizeof(length) + length) return false;
+        response.value = 0;
+        response.message.assign(data, offset + 1 + sizeof(length), length);
+        offset += 1 + sizeof(length) + length;
+    }
+    response.status = status;
+    return true;
+}
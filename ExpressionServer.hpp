@@ -0,0 +1,141 @@
+#ifndef EXPRESSION_SERVER_HPP
+#define EXPRESSION_SERVER_HPP
+
+#include "ExpressionEvaluator.hpp"
+#include "CompiledExpression.hpp"
+#include <string>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <deque>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * Long-running evaluation server on a Unix domain socket
+ *
+ * Protocol (all integers in host byte order, the socket is local only):
+ *   request:  uint32 length, then `length` bytes of expression text
+ *   response: uint8 STATUS_OK followed by a double result, or
+ *             uint8 STATUS_ERROR followed by uint32 length and the message
+ *
+ * Responses are sent in request order. A client may pipeline any number of
+ * requests; every complete request found in one read is evaluated as a batch
+ * and answered with a single write. Requests are parsed, compiled and
+ * evaluated without recursion (see CompiledExpression), so no request,
+ * however deeply nested, can overflow the stack; the cache holds compiled
+ * expressions. A connection whose client does not read its responses stops
+ * being read once MAX_PENDING_OUTPUT bytes are waiting, so neither its
+ * output nor its input buffer grows without bound (the input holds at most
+ * one partial request of up to MAX_REQUEST_LENGTH bytes).
+ */
+class ExpressionServer {
+public:
+    enum Status : uint8_t {
+        STATUS_OK = 0,
+        STATUS_ERROR = 1
+    };
+
+    // Requests longer than this close the connection
+    static const uint32_t MAX_REQUEST_LENGTH = 64 * 1024 * 1024;
+
+    // Encoded responses a connection may have waiting before it stops being read
+    static const size_t MAX_PENDING_OUTPUT = 4 * 1024 * 1024;
+
+    // Decoded response, as seen by a client
+    struct Response {
+        Status status;
+        double value;
+        std::string message;
+    };
+
+    // Throughput and latency since the previous report. Latency is measured
+    // per request, from reading its last byte to writing its response to the
+    // socket, so it includes time spent queued behind earlier requests.
+    struct Stats {
+        uint64_t requests;
+        uint64_t cacheHits;
+        double requestsPerSecond;
+        double p50Microseconds;
+        double p99Microseconds;
+    };
+
+    explicit ExpressionServer(const std::string& socketPath, size_t cacheCapacity = 4096);
+    ~ExpressionServer();
+
+    ExpressionServer(const ExpressionServer&) = delete;
+    ExpressionServer& operator=(const ExpressionServer&) = delete;
+
+    // Serve clients until stop() is called; prints stats every reportSeconds
+    void run(int reportSeconds = 5);
+
+    // Ask run() to return (safe to call from a signal handler)
+    void stop() { running.store(false, std::memory_order_relaxed); }
+
+    // Collect and reset the statistics gathered since the previous call
+    Stats takeStats();
+
+    // Protocol helpers shared with clients
+    static void encodeRequest(std::string& out, const std::string& expression);
+    static void encodeResponse(std::string& out, Status status, double value, const std::string& message);
+    // Decode one response from data[offset, size); returns false if incomplete
+    static bool decodeResponse(const std::string& data, size_t& offset, Response& response);
+
+private:
+    struct Connection {
+        std::string input;      // Bytes read but not yet parsed into requests
+        std::string output;     // Encoded responses not yet written
+        uint64_t queuedBytes = 0;       // Response bytes ever queued
+        uint64_t sentBytes = 0;         // Response bytes ever written
+        // Per queued response: queuedBytes at its end, and when its request was read
+        std::deque<std::pair<uint64_t, double>> pending;
+    };
+
+    // Accept all pending connections on the listening socket
+    void acceptConnections();
+
+    // Read available data, evaluate complete requests and queue responses
+    void handleReadable(int fd);
+
+    // Evaluate the complete requests at the front of the connection's input,
+    // read at readTime; returns false if a request is too long
+    bool evaluateRequests(Connection& connection, double readTime);
+
+    // Write as much pending output as the socket accepts
+    void flushOutput(int fd);
+
+    // Watch for input unless too much output is waiting, and for writability
+    // while any output is waiting
+    void updateEvents(int fd, const Connection& connection);
+
+    void closeConnection(int fd);
+
+    // Evaluate one request, using the compiled expression cache
+    void evaluateRequest(const std::string& expression, std::string& out);
+
+    // Look up a compiled expression, building and caching it on a miss;
+    // returns nullptr and sets error if the expression does not parse
+    const CompiledExpression* compile(const std::string& expression, ExpressionError::Code& error);
+
+    std::string socketPath;
+    int listenFd;
+    int epollFd;
+    std::atomic<bool> running;     // Cleared by stop(), possibly from a signal handler
+    static_assert(std::atomic<bool>::is_always_lock_free, "stop() must be async-signal-safe");
+
+    ExpressionEvaluator evaluator;
+    std::unordered_map<int, Connection> connections;
+
+    // LRU cache of compiled expressions shared by all connections
+    size_t cacheCapacity;
+    std::list<std::pair<std::string, CompiledExpression>> cacheOrder;
+    std::unordered_map<std::string, std::list<std::pair<std::string, CompiledExpression>>::iterator> cache;
+
+    // Statistics since the last report
+    std::vector<double> latencySamples;
+    uint64_t cacheHits;
+    double statsStart;
+};
+
+#endif // EXPRESSION_SERVER_HPP
@@ -2,6 +2,28 @@
 #include <iostream>
 #include <iomanip>
 #include <sstream>
+#include <vector>
+#include <utility>
+#include <algorithm>
+
+// Message for an error code
+const char* ExpressionError::message(Code code) {
+    switch (code) {
+    case NONE:                   return "No error";
+    case DIVISION_BY_ZERO:       return "Error: Division by zero";
+    case MODULO_BY_ZERO:         return "Error: Modulo by zero";
+    case MISMATCHED_PARENTHESES: return "Error: Mismatched parentheses";
+    case INVALID_UNARY_SYNTAX:   return "Error: Invalid expression syntax for unary operator";
+    case INVALID_BINARY_SYNTAX:  return "Error: Invalid expression syntax for binary operator";
+    case INVALID_EXPRESSION:     return "Error: Invalid expression";
+    case NULL_NODE:              return "Error: Null node encountered during evaluation";
+    case UNKNOWN_OPERATOR:       return "Error: Unknown operator";
+    case UNKNOWN_VARIABLE:       return "Error: Unknown variable";
+    case SHIFT_OUT_OF_RANGE:     return "Error: Shift count out of range";
+    case BITWISE_OUT_OF_RANGE:   return "Error: Bitwise operand out of range";
+    default:                     return "Error: Unknown error";
+    }
+}
 
 // Constructor
 ExpressionTree::ExpressionTree(NodePtr root) : root(root) {}
@@ -52,6 +74,8 @@ void ExpressionTree::inOrderHelper(NodePtr node, std::string& result) const {
         std::ostringstream ss;
         ss << node->getValue();
         result += ss.str();
+    } else if (node->isVariable()) {
+        result += node->getName();
     } else {
         result += " " + node->getOperator() + " ";
     }
@@ -73,6 +97,8 @@ void ExpressionTree::preOrderHelper(NodePtr node, std::string& result) const {
         std::ostringstream ss;
         ss << node->getValue();
         result += ss.str() + " ";
+    } else if (node->isVariable()) {
+        result += node->getName() + " ";
     } else {
         result += node->getOperator() + " ";
     }
@@ -107,6 +133,8 @@ void ExpressionTree::postOrderHelper(NodePtr node, std::string& result) const {
         std::ostringstream ss;
         ss << node->getValue();
         result += ss.str() + " ";
+    } else if (node->isVariable()) {
+        result += node->getName() + " ";
     } else {
         result += node->getOperator() + " ";
     }
@@ -114,26 +142,54 @@ void ExpressionTree::postOrderHelper(NodePtr node, std::string& result) const {
 
 // Display the tree structure (useful for debugging)
 void ExpressionTree::displayTree() const {
-    std::cout << "Expression Tree Structure:\n";
-    displayTreeHelper(root, 0);
-    std::cout << std::endl;
+    displayTree(std::cout, nullptr);
+}
+
+// Display the tree structure, annotating every node
+void ExpressionTree::displayTree(std::ostream& out, const NodeAnnotation& annotate) const {
+    out << "Expression Tree Structure:\n";
+    displayTreeHelper(root, 0, out, annotate);
+    out << std::endl;
 }
 
 // Helper method for displaying the tree
-void ExpressionTree::displayTreeHelper(NodePtr node, int level) const {
+void ExpressionTree::displayTreeHelper(NodePtr node, int level, std::ostream& out,
+                                       const NodeAnnotation& annotate) const {
     if (!node) return;
     
     // Display right subtree
-    displayTreeHelper(node->getRight(), level + 1);
+    displayTreeHelper(node->getRight(), level + 1, out, annotate);
     
     // Display current node
-    std::cout << std::setw(level * 4) << "";
+    out << std::setw(level * 4) << "";
     if (node->isOperand()) {
-        std::cout << node->getValue() << std::endl;
+        out << node->getValue();
+    } else if (node->isVariable()) {
+        out << node->getName();
     } else {
-        std::cout << node->getOperator() << std::endl;
+        out << node->getOperator();
     }
+    if (annotate) {
+        out << annotate(*node);
+    }
+    out << std::endl;
     
     // Display left subtree
-    displayTreeHelper(node->getLeft(), level + 1);
+    displayTreeHelper(node->getLeft(), level + 1, out, annotate);
+}
+
+// Height of the tree, walking it with an explicit stack of (node, depth)
+size_t ExpressionTree::getHeight() const {
+    size_t height = 0;
+    std::vector<std::pair<const Node*, size_t>> pending;
+    if (root) pending.emplace_back(root.get(), 1);
+    while (!pending.empty()) {
+        auto [node, depth] = pending.back();
+        pending.pop_back();
+        height = std::max(height, depth);
+        for (const NodePtr& child : {node->getLeft(), node->getRight()}) {
+            if (child) pending.emplace_back(child.get(), depth + 1);
+        }
+    }
+    return height;
 }
@@ -4,14 +4,43 @@
 #include "Node.hpp"
 #include <string>
 #include <vector>
+#include <functional>
+#include <ostream>
 #include <stdexcept>
+#include <cstddef>
 
 /**
  * Custom exception class for expression errors
+ * The error codes are also returned directly by the non-throwing API
  */
 class ExpressionError : public std::runtime_error {
 public:
-    explicit ExpressionError(const std::string& message) : std::runtime_error(message) {}
+    enum Code {
+        NONE = 0,
+        DIVISION_BY_ZERO,
+        MODULO_BY_ZERO,
+        MISMATCHED_PARENTHESES,
+        INVALID_UNARY_SYNTAX,
+        INVALID_BINARY_SYNTAX,
+        INVALID_EXPRESSION,
+        NULL_NODE,
+        UNKNOWN_OPERATOR,
+        UNKNOWN_VARIABLE,
+        SHIFT_OUT_OF_RANGE,
+        BITWISE_OUT_OF_RANGE,
+        OTHER
+    };
+
+    explicit ExpressionError(const std::string& message) : std::runtime_error(message), errorCode(OTHER) {}
+    explicit ExpressionError(Code code) : std::runtime_error(message(code)), errorCode(code) {}
+
+    Code code() const { return errorCode; }
+
+    // Message for an error code, e.g. "Error: Division by zero"
+    static const char* message(Code code);
+
+private:
+    Code errorCode;
 };
 
 /**
@@ -39,6 +68,16 @@ public:
     
     // Display the tree structure (for debugging)
     void displayTree() const;
+    
+    // Text appended to the line of a node by displayTree
+    using NodeAnnotation = std::function<std::string(const Node&)>;
+    
+    // Display the tree structure with an annotation after every node
+    void displayTree(std::ostream& out, const NodeAnnotation& annotate) const;
+    
+    // Number of nodes on the longest root-to-leaf path (0 for an empty tree).
+    // Iterative, so it also works on chains too deep to evaluate recursively.
+    size_t getHeight() const;
 
 private:
     NodePtr root;
@@ -49,7 +88,7 @@ private:
     void postOrderHelper(NodePtr node, std::string& result) const;
     
     // Helper method for displaying the tree
-    void displayTreeHelper(NodePtr node, int level) const;
+    void displayTreeHelper(NodePtr node, int level, std::ostream& out, const NodeAnnotation& annotate) const;
 };
 
 #endif // EXPRESSION_TREE_HPP
@@ -1,33 +1,73 @@
 #include "Node.hpp"
 #include <iostream>
+#include <vector>
+#include <utility>
 
 // Constructor for operands (numeric values)
-Node::Node(double value) : type(OPERAND), value(value), op(""), left(nullptr), right(nullptr) {}
+Node::Node(double value)
+    : type(OPERAND), valueType(FLOAT), value(value), intValue(0), op(""), left(nullptr), right(nullptr) {}
+
+// Constructor for integer operands
+Node::Node(long long value)
+    : type(OPERAND), valueType(INTEGER), value(static_cast<double>(value)), intValue(value),
+      op(""), left(nullptr), right(nullptr) {}
+
+// Constructor for variables
+Node::Node(const std::string& name)
+    : type(VARIABLE), valueType(FLOAT), value(0), intValue(0), op(name), left(nullptr), right(nullptr) {}
 
 // Constructor for binary operators (char version)
 Node::Node(char op, NodePtr left, NodePtr right)
-    : type(OPERATOR), value(0), op(1, op), left(left), right(right) {}
+    : type(OPERATOR), valueType(FLOAT), value(0), intValue(0), op(1, op), left(left), right(right) {}
 
 // Constructor for unary operators (char version)
 Node::Node(char op, NodePtr right)
-    : type(UNARY_OP), value(0), op(1, op), left(nullptr), right(right) {}
+    : type(UNARY_OP), valueType(FLOAT), value(0), intValue(0), op(1, op), left(nullptr), right(right) {}
 
 // Constructor for binary operators (string version)
 Node::Node(const std::string& op, NodePtr left, NodePtr right)
-    : type(OPERATOR), value(0), op(op), left(left), right(right) {}
+    : type(OPERATOR), valueType(FLOAT), value(0), intValue(0), op(op), left(left), right(right) {}
 
 // Constructor for unary operators (string version)
 Node::Node(const std::string& op, NodePtr right)
-    : type(UNARY_OP), value(0), op(op), left(nullptr), right(right) {}
+    : type(UNARY_OP), valueType(FLOAT), value(0), intValue(0), op(op), left(nullptr), right(right) {}
+
+// Destructor. Children owned only by this node are moved onto an explicit
+// stack, and theirs in turn, so each node is destroyed with no children left
+// to release recursively. Shared children (rebalance shares untouched
+// subtrees) only lose a reference. Leaf children need no stack.
+Node::~Node() {
+    std::vector<NodePtr> pending;
+    auto take = [&pending](NodePtr& child) {
+        if (child && child.use_count() == 1 && (child->left || child->right)) {
+            pending.push_back(std::move(child));
+        }
+    };
+    take(left);
+    take(right);
+    while (!pending.empty()) {
+        NodePtr node = std::move(pending.back());
+        pending.pop_back();
+        take(node->left);
+        take(node->right);
+    }
+}
 
 // Display node information (useful for debugging)
 void Node::displayNode() const {
     if (type == OPERAND) {
-        std::cout << "Operand: " << value;
+        std::cout << "Operand: ";
+        if (valueType == INTEGER) {
+            std::cout << intValue;
+        } else {
+            std::cout << value;
+        }
     } else if (type == OPERATOR) {
         std::cout << "Operator: " << op;
     } else if (type == UNARY_OP) {
         std::cout << "Unary Operator: " << op;
+    } else if (type == VARIABLE) {
+        std::cout << "Variable: " << op;
     }
     
     std::cout << std::endl;
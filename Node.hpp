@@ -17,20 +17,36 @@ public:
     enum NodeType {
         OPERAND,    // Numeric value
         OPERATOR,   // Binary operator (+, -, *, /, etc.)
-        UNARY_OP    // Unary operator (-, ~, not)
+        UNARY_OP,   // Unary operator (-, ~, not)
+        VARIABLE    // Named input bound at evaluation time
+    };
+
+    // Static type of the value a node evaluates to
+    enum ValueType {
+        FLOAT,      // double
+        INTEGER     // 64-bit signed integer
     };
 
     // Constructors
     Node(double value);                        // For operands
+    Node(long long value);                     // For integer operands
+    explicit Node(const std::string& name);    // For variables
     Node(char op, NodePtr left, NodePtr right); // For binary operators
     Node(char op, NodePtr right);              // For unary operators
     Node(const std::string& op, NodePtr left, NodePtr right); // For multi-char operators
     Node(const std::string& op, NodePtr right); // For multi-char unary operators
 
+    // Releases the subtree iteratively, so chains too deep to destroy
+    // recursively (such as a parsed 1 + 1 + ... + 1) are freed safely
+    ~Node();
+
     // Getters
     NodeType getType() const { return type; }
     double getValue() const { return value; }
+    long long getIntegerValue() const { return intValue; }
+    ValueType getValueType() const { return valueType; }
     std::string getOperator() const { return op; }
+    const std::string& getName() const { return op; } // Variable name
     NodePtr getLeft() const { return left; }
     NodePtr getRight() const { return right; }
     
@@ -38,14 +54,21 @@ public:
     bool isOperand() const { return type == OPERAND; }
     bool isOperator() const { return type == OPERATOR; }
     bool isUnaryOp() const { return type == UNARY_OP; }
+    bool isVariable() const { return type == VARIABLE; }
+    bool isInteger() const { return valueType == INTEGER; }
+    
+    // Set by type inference when the node is built
+    void setValueType(ValueType newType) { valueType = newType; }
 
     // Display methods (for debugging)
     void displayNode() const;
     
 private:
     NodeType type;          // Type of the node
+    ValueType valueType;    // Inferred type of the node's value
     double value;           // Value if the node is an operand
-    std::string op;         // Operator string if the node is an operator
+    long long intValue;     // Exact value if the node is an integer operand
+    std::string op;         // Operator string, or the name of a variable
     NodePtr left;           // Left child
     NodePtr right;          // Right child
 };
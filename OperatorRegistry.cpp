@@ -0,0 +1,315 @@
+#include "OperatorRegistry.hpp"
+#include <array>
+#include <set>
+#include <mutex>
+#include <cctype>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+// Native int64 kernels; see OperatorDescriptor::IntegerKernel
+bool addInteger(long long a, long long b, long long& result, ExpressionError::Code&) {
+    return !__builtin_add_overflow(a, b, &result);
+}
+
+bool subtractInteger(long long a, long long b, long long& result, ExpressionError::Code&) {
+    return !__builtin_sub_overflow(a, b, &result);
+}
+
+bool multiplyInteger(long long a, long long b, long long& result, ExpressionError::Code&) {
+    return !__builtin_mul_overflow(a, b, &result);
+}
+
+bool moduloInteger(long long a, long long b, long long& result, ExpressionError::Code& error) {
+    if (b == 0) {
+        error = ExpressionError::MODULO_BY_ZERO;
+        return false;
+    }
+    result = (b == -1) ? 0 : a % b;
+    return true;
+}
+
+// Exact integer power; negative exponents have no integer result
+bool powerInteger(long long a, long long b, long long& result, ExpressionError::Code&) {
+    if (b < 0) return false;
+    long long base = a;
+    result = 1;
+    while (b > 0) {
+        if ((b & 1) && __builtin_mul_overflow(result, base, &result)) return false;
+        b >>= 1;
+        if (b > 0 && __builtin_mul_overflow(base, base, &base)) return false;
+    }
+    return true;
+}
+
+bool shiftInteger(long long a, long long b, bool left, long long& result, ExpressionError::Code& error) {
+    if (b < 0 || b > 63) {
+        error = ExpressionError::SHIFT_OUT_OF_RANGE;
+        return false;
+    }
+    result = left ? static_cast<long long>(static_cast<unsigned long long>(a) << b) : a >> b;
+    return true;
+}
+
+#define INTEGER_KERNEL(name, expression) \
+    bool name(long long a, long long b, long long& result, ExpressionError::Code&) { \
+        result = (expression); \
+        return true; \
+    }
+
+INTEGER_KERNEL(equalInteger, a == b)
+INTEGER_KERNEL(notEqualInteger, a != b)
+INTEGER_KERNEL(lessInteger, a < b)
+INTEGER_KERNEL(greaterInteger, a > b)
+INTEGER_KERNEL(lessEqualInteger, a <= b)
+INTEGER_KERNEL(greaterEqualInteger, a >= b)
+INTEGER_KERNEL(logicalAndInteger, a != 0 && b != 0)
+INTEGER_KERNEL(logicalOrInteger, a != 0 || b != 0)
+INTEGER_KERNEL(bitAndInteger, a & b)
+INTEGER_KERNEL(bitOrInteger, a | b)
+INTEGER_KERNEL(bitXorInteger, a ^ b)
+
+#undef INTEGER_KERNEL
+
+bool shiftLeftInteger(long long a, long long b, long long& result, ExpressionError::Code& error) {
+    return shiftInteger(a, b, true, result, error);
+}
+
+bool shiftRightInteger(long long a, long long b, long long& result, ExpressionError::Code& error) {
+    return shiftInteger(a, b, false, result, error);
+}
+
+// Apply a bitwise kernel to two doubles; NaN if an operand is out of range
+template <OperatorDescriptor::IntegerKernel kernel>
+double bitwise(double a, double b) {
+    long long x, y, result;
+    ExpressionError::Code error = ExpressionError::NONE;
+    if (!OperatorRegistry::toInteger(a, x) || !OperatorRegistry::toInteger(b, y) || !kernel(x, y, result, error)) {
+        return std::nan("");
+    }
+    return static_cast<double>(result);
+}
+
+// Double kernels
+double add(double a, double b) { return a + b; }
+double subtract(double a, double b) { return a - b; }
+double multiply(double a, double b) { return a * b; }
+// Zero divisors are reported by the evaluator before these are called
+double divide(double a, double b) { return a / b; }
+double modulo(double a, double b) { return std::fmod(a, b); }
+double power(double a, double b) { return std::pow(a, b); }
+double equal(double a, double b) { return a == b ? 1.0 : 0.0; }
+double notEqual(double a, double b) { return a != b ? 1.0 : 0.0; }
+double less(double a, double b) { return a < b ? 1.0 : 0.0; }
+double greater(double a, double b) { return a > b ? 1.0 : 0.0; }
+double lessEqual(double a, double b) { return a <= b ? 1.0 : 0.0; }
+double greaterEqual(double a, double b) { return a >= b ? 1.0 : 0.0; }
+double logicalAnd(double a, double b) { return (a != 0 && b != 0) ? 1.0 : 0.0; }
+double logicalOr(double a, double b) { return (a != 0 || b != 0) ? 1.0 : 0.0; }
+double negate(double a) { return -a; }
+double logicalNot(double a) { return (a == 0) ? 1.0 : 0.0; }
+
+double bitNot(double a) {
+    long long x;
+    return OperatorRegistry::toInteger(a, x) ? static_cast<double>(~x) : std::nan("");
+}
+
+using Descriptor = OperatorDescriptor;
+const int UNARY = OperatorRegistry::UNARY_PRECEDENCE;
+
+// The built-in operators. Primary descriptors come first, in id order,
+// followed by the keyword aliases.
+constexpr Descriptor BUILTIN_OPERATORS[] = {
+    {"+", Descriptor::ADD, 2, 5, false, Descriptor::ARITHMETIC, nullptr, add, addInteger},
+    {"-", Descriptor::SUBTRACT, 2, 5, false, Descriptor::ARITHMETIC, nullptr, subtract, subtractInteger},
+    {"*", Descriptor::MULTIPLY, 2, 6, false, Descriptor::ARITHMETIC, nullptr, multiply, multiplyInteger},
+    {"/", Descriptor::DIVIDE, 2, 6, false, Descriptor::DIVISION, nullptr, divide, nullptr},
+    {"%", Descriptor::MODULO, 2, 6, false, Descriptor::ARITHMETIC, nullptr, modulo, moduloInteger},
+    {"^", Descriptor::POWER, 2, 7, true, Descriptor::ARITHMETIC, nullptr, power, powerInteger},
+    {"==", Descriptor::EQUAL, 2, 2, false, Descriptor::COMPARISON, nullptr, equal, equalInteger},
+    {"!=", Descriptor::NOT_EQUAL, 2, 2, false, Descriptor::COMPARISON, nullptr, notEqual, notEqualInteger},
+    {"<", Descriptor::LESS, 2, 3, false, Descriptor::COMPARISON, nullptr, less, lessInteger},
+    {">", Descriptor::GREATER, 2, 3, false, Descriptor::COMPARISON, nullptr, greater, greaterInteger},
+    {"<=", Descriptor::LESS_EQUAL, 2, 3, false, Descriptor::COMPARISON, nullptr, lessEqual, lessEqualInteger},
+    {">=", Descriptor::GREATER_EQUAL, 2, 3, false, Descriptor::COMPARISON, nullptr, greaterEqual,
+     greaterEqualInteger},
+    {"&&", Descriptor::LOGICAL_AND, 2, 1, false, Descriptor::LOGICAL, nullptr, logicalAnd, logicalAndInteger},
+    {"||", Descriptor::LOGICAL_OR, 2, 1, false, Descriptor::LOGICAL, nullptr, logicalOr, logicalOrInteger},
+    {"&", Descriptor::BIT_AND, 2, 1, false, Descriptor::BITWISE, nullptr, bitwise<bitAndInteger>, bitAndInteger},
+    {"|", Descriptor::BIT_OR, 2, 1, false, Descriptor::BITWISE, nullptr, bitwise<bitOrInteger>, bitOrInteger},
+    // "xor" rather than "^", which is the power operator
+    {"xor", Descriptor::BIT_XOR, 2, 1, false, Descriptor::BITWISE, nullptr, bitwise<bitXorInteger>, bitXorInteger},
+    {"<<", Descriptor::SHIFT_LEFT, 2, 4, false, Descriptor::BITWISE, nullptr, bitwise<shiftLeftInteger>,
+     shiftLeftInteger},
+    {">>", Descriptor::SHIFT_RIGHT, 2, 4, false, Descriptor::BITWISE, nullptr, bitwise<shiftRightInteger>,
+     shiftRightInteger},
+    {"u-", Descriptor::NEGATE, 1, UNARY, true, Descriptor::ARITHMETIC, negate, nullptr, nullptr},
+    {"~", Descriptor::BIT_NOT, 1, UNARY, true, Descriptor::BITWISE, bitNot, nullptr, nullptr},
+    {"not", Descriptor::LOGICAL_NOT, 1, UNARY, true, Descriptor::LOGICAL, logicalNot, nullptr, nullptr},
+
+    // Keyword operators
+    {"and", Descriptor::LOGICAL_AND, 2, 1, false, Descriptor::LOGICAL, nullptr, logicalAnd, logicalAndInteger},
+    {"or", Descriptor::LOGICAL_OR, 2, 1, false, Descriptor::LOGICAL, nullptr, logicalOr, logicalOrInteger},
+};
+
+constexpr size_t BUILTIN_COUNT = sizeof(BUILTIN_OPERATORS) / sizeof(BUILTIN_OPERATORS[0]);
+constexpr size_t BUILTIN_TABLE_SIZE = 128;
+
+// True if seed sends every symbol in operators[0, count) to its own slot
+constexpr bool isPerfect(const Descriptor* operators, size_t count, uint32_t seed, size_t tableSize) {
+    bool used[1024] = {};
+    for (size_t i = 0; i < count; ++i) {
+        size_t slot = OperatorRegistry::hashSymbol(operators[i].symbol, seed) & (tableSize - 1);
+        if (used[slot]) return false;
+        used[slot] = true;
+    }
+    return true;
+}
+
+constexpr uint32_t findBuiltinSeed() {
+    uint32_t seed = 0;
+    while (!isPerfect(BUILTIN_OPERATORS, BUILTIN_COUNT, seed, BUILTIN_TABLE_SIZE)) ++seed;
+    return seed;
+}
+
+constexpr std::array<int16_t, BUILTIN_TABLE_SIZE> makeBuiltinSlots(uint32_t seed) {
+    std::array<int16_t, BUILTIN_TABLE_SIZE> slots{};
+    for (size_t i = 0; i < BUILTIN_TABLE_SIZE; ++i) slots[i] = -1;
+    for (size_t i = 0; i < BUILTIN_COUNT; ++i) {
+        slots[OperatorRegistry::hashSymbol(BUILTIN_OPERATORS[i].symbol, seed) & (BUILTIN_TABLE_SIZE - 1)] =
+            static_cast<int16_t>(i);
+    }
+    return slots;
+}
+
+constexpr uint32_t BUILTIN_SEED = findBuiltinSeed();
+constexpr std::array<int16_t, BUILTIN_TABLE_SIZE> BUILTIN_SLOTS = makeBuiltinSlots(BUILTIN_SEED);
+
+// Compile-time lookup in the built-in table
+constexpr const Descriptor* findBuiltin(std::string_view symbol) {
+    int index = BUILTIN_SLOTS[OperatorRegistry::hashSymbol(symbol, BUILTIN_SEED) & (BUILTIN_TABLE_SIZE - 1)];
+    return (index >= 0 && BUILTIN_OPERATORS[index].symbol == symbol) ? &BUILTIN_OPERATORS[index] : nullptr;
+}
+
+static_assert(findBuiltin("<<")->id == Descriptor::SHIFT_LEFT, "perfect hash lookup");
+static_assert(findBuiltin("or")->id == Descriptor::LOGICAL_OR, "perfect hash lookup");
+static_assert(findBuiltin("<>") == nullptr, "perfect hash lookup");
+static_assert(BUILTIN_OPERATORS[Descriptor::LOGICAL_NOT].id == Descriptor::LOGICAL_NOT &&
+              BUILTIN_OPERATORS[Descriptor::USER].id == Descriptor::LOGICAL_AND,
+              "primary descriptors are in id order");
+
+// Registered symbols live for the whole program so that descriptors (and
+// copies of registries) can keep string_views to them
+std::string_view internSymbol(const std::string& symbol) {
+    static std::mutex mutex;
+    static std::set<std::string> symbols;
+    std::lock_guard<std::mutex> lock(mutex);
+    return *symbols.insert(symbol).first;
+}
+
+} // namespace
+
+OperatorRegistry::OperatorRegistry(bool withBuiltins) : slots(1, -1), seed(0), maxSymbolLength(0),
+                                                        userOperators(false) {
+    if (!withBuiltins) {
+        return;
+    }
+    descriptors.assign(BUILTIN_OPERATORS, BUILTIN_OPERATORS + BUILTIN_COUNT);
+    for (size_t i = 0; i < Descriptor::USER; ++i) {
+        primary.push_back(static_cast<int16_t>(i));
+    }
+    slots.assign(BUILTIN_SLOTS.begin(), BUILTIN_SLOTS.end());
+    seed = BUILTIN_SEED;
+    maxSymbolLength = 2;
+}
+
+// Register a binary operator
+const OperatorDescriptor& OperatorRegistry::addBinary(const std::string& symbol, int precedence,
+                                                      bool rightAssociative, OperatorDescriptor::BinaryKernel kernel) {
+    return add(OperatorDescriptor{{}, 0, 2, precedence, rightAssociative, OperatorDescriptor::CUSTOM,
+                                  nullptr, kernel, nullptr}, symbol);
+}
+
+// Register a prefix unary operator
+const OperatorDescriptor& OperatorRegistry::addUnary(const std::string& symbol,
+                                                     OperatorDescriptor::UnaryKernel kernel) {
+    return add(OperatorDescriptor{{}, 0, 1, UNARY_PRECEDENCE, true, OperatorDescriptor::CUSTOM,
+                                  kernel, nullptr, nullptr}, symbol);
+}
+
+// Longest operator-character symbol at the start of text
+const OperatorDescriptor* OperatorRegistry::match(std::string_view text) const {
+    for (size_t length = std::min(maxSymbolLength, text.length()); length > 0; --length) {
+        const OperatorDescriptor* op = find(text.substr(0, length));
+        if (op && isOperatorCharacter(op->symbol[0])) {
+            return op;
+        }
+    }
+    return nullptr;
+}
+
+// Operator characters: punctuation that does not start or delimit another token
+bool OperatorRegistry::isOperatorCharacter(char c) {
+    return std::ispunct(static_cast<unsigned char>(c)) && !std::strchr("()._", c);
+}
+
+// Convert a bitwise operand to a 64-bit integer
+bool OperatorRegistry::toInteger(double value, long long& result) {
+    if (!(value >= -9223372036854775808.0 && value < 9223372036854775808.0)) {
+        return false;
+    }
+    result = static_cast<long long>(value);
+    return true;
+}
+
+const OperatorDescriptor& OperatorRegistry::add(OperatorDescriptor descriptor, const std::string& symbol) {
+    bool isWord = !symbol.empty() && std::isalpha(static_cast<unsigned char>(symbol[0]));
+    for (char c : symbol) {
+        bool valid = isWord ? (std::isalnum(static_cast<unsigned char>(c)) || c == '_') : isOperatorCharacter(c);
+        if (!valid) {
+            throw ExpressionError("Error: Invalid operator symbol '" + symbol + "'");
+        }
+    }
+    if (symbol.empty() || find(symbol)) {
+        throw ExpressionError("Error: Invalid operator symbol '" + symbol + "'");
+    }
+
+    descriptor.symbol = internSymbol(symbol);
+    descriptor.id = static_cast<int>(std::max<size_t>(primary.size(), OperatorDescriptor::USER));
+    primary.resize(descriptor.id + 1, -1);
+    primary[descriptor.id] = static_cast<int16_t>(descriptors.size());
+    descriptors.push_back(descriptor);
+    if (!isWord) {
+        maxSymbolLength = std::max(maxSymbolLength, symbol.length());
+    }
+    userOperators = true;
+    rehash();
+    return descriptors.back();
+}
+
+// Try seeds until every symbol has its own slot; the table is kept at least
+// four times the number of symbols, so a seed is found after a few tries
+void OperatorRegistry::rehash() {
+    size_t tableSize = 2;
+    while (tableSize < descriptors.size() * 4) tableSize <<= 1;
+
+    for (uint32_t candidate = 0;; ++candidate) {
+        if (candidate == 4096) {
+            candidate = 0;
+            tableSize <<= 1;
+        }
+        std::vector<int16_t> table(tableSize, -1);
+        bool perfect = true;
+        for (size_t i = 0; i < descriptors.size() && perfect; ++i) {
+            int16_t& slot = table[hashSymbol(descriptors[i].symbol, candidate) & (tableSize - 1)];
+            perfect = (slot < 0);
+            slot = static_cast<int16_t>(i);
+        }
+        if (perfect) {
+            slots.swap(table);
+            seed = candidate;
+            return;
+        }
+    }
+}
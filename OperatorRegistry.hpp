@@ -0,0 +1,126 @@
+#ifndef OPERATOR_REGISTRY_HPP
+#define OPERATOR_REGISTRY_HPP
+
+#include "ExpressionTree.hpp"
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Description of one operator: spelling, arity, precedence, associativity
+ * and evaluation kernels. Keyword aliases ("and", "or") share the id of
+ * their symbolic form.
+ */
+struct OperatorDescriptor {
+    // Built-in operator ids; registered operators get ids from USER upwards
+    enum Id {
+        ADD, SUBTRACT, MULTIPLY, DIVIDE, MODULO, POWER,
+        EQUAL, NOT_EQUAL, LESS, GREATER, LESS_EQUAL, GREATER_EQUAL,
+        LOGICAL_AND, LOGICAL_OR, BIT_AND, BIT_OR, BIT_XOR, SHIFT_LEFT, SHIFT_RIGHT,
+        NEGATE, BIT_NOT, LOGICAL_NOT,
+        USER
+    };
+
+    // How the evaluator types the result: ARITHMETIC stays integer when its
+    // operands are, DIVISION and CUSTOM always yield doubles, the others
+    // always yield integers
+    enum Category { ARITHMETIC, DIVISION, COMPARISON, LOGICAL, BITWISE, CUSTOM };
+
+    using UnaryKernel = double (*)(double);
+    using BinaryKernel = double (*)(double, double);
+    // Exact int64 kernel: returns false on overflow, or with error set on failure
+    using IntegerKernel = bool (*)(long long, long long, long long&, ExpressionError::Code&);
+
+    std::string_view symbol;    // Spelling in the token stream ("u-" for unary minus)
+    int id;
+    int arity;                  // 1 for prefix operators, 2 for binary operators
+    int precedence;
+    bool rightAssociative;
+    Category category;
+    UnaryKernel unary;          // Set for arity 1
+    BinaryKernel binary;        // Set for arity 2
+    IntegerKernel integer;      // Built-in binary operators only
+
+    bool isUnary() const { return arity == 1; }
+};
+
+/**
+ * Operator table shared by the lexer, the shunting-yard parser and the
+ * evaluators
+ *
+ * Symbols are found through a perfect hash: every symbol owns its own slot,
+ * so a lookup hashes once and compares one candidate. For the built-in
+ * operators the hash seed and slot table are computed at compile time;
+ * registering an operator re-seeds the hash of that registry.
+ *
+ * Descriptor pointers stay valid until the next registration.
+ */
+class OperatorRegistry {
+public:
+    // Precedence of prefix operators (binds tighter than any binary operator)
+    static const int UNARY_PRECEDENCE = 8;
+
+    // A registry with the built-in operators, or an empty one
+    explicit OperatorRegistry(bool withBuiltins = true);
+
+    // Register an operator. The symbol must be a word ("mod") or a run of
+    // operator characters ("**"); throws ExpressionError otherwise, or if
+    // the symbol is already registered.
+    const OperatorDescriptor& addBinary(const std::string& symbol, int precedence, bool rightAssociative,
+                                        OperatorDescriptor::BinaryKernel kernel);
+    const OperatorDescriptor& addUnary(const std::string& symbol, OperatorDescriptor::UnaryKernel kernel);
+
+    // Find an operator by its token spelling; nullptr if there is none
+    const OperatorDescriptor* find(std::string_view symbol) const {
+        int index = slots[hashSymbol(symbol, seed) & (slots.size() - 1)];
+        return (index >= 0 && descriptors[index].symbol == symbol) ? &descriptors[index] : nullptr;
+    }
+
+    // Find the operator of a unary tree node (unary minus is spelled "-" there)
+    const OperatorDescriptor* findUnary(std::string_view symbol) const {
+        return find(symbol == "-" ? std::string_view("u-") : symbol);
+    }
+
+    // Longest operator-character symbol at the start of text; nullptr if none
+    const OperatorDescriptor* match(std::string_view text) const;
+
+    // The primary descriptor of an operator (keyword aliases map to their symbol)
+    const OperatorDescriptor& canonical(const OperatorDescriptor& op) const { return descriptors[primary[op.id]]; }
+
+    // True once an operator has been registered at run time
+    bool hasUserOperators() const { return userOperators; }
+
+    // Characters that may form operator symbols
+    static bool isOperatorCharacter(char c);
+
+    // Convert a bitwise operand to a 64-bit integer (truncating toward zero).
+    // Returns false if the value is NaN or outside the int64 range.
+    static bool toInteger(double value, long long& result);
+
+    // Seeded FNV-1a hash of a symbol
+    static constexpr uint32_t hashSymbol(std::string_view symbol, uint32_t seed) {
+        uint32_t hash = 2166136261u ^ seed;
+        for (char c : symbol) {
+            hash ^= static_cast<unsigned char>(c);
+            hash *= 16777619u;
+        }
+        return hash ^ (hash >> 15);
+    }
+
+private:
+    const OperatorDescriptor& add(OperatorDescriptor descriptor, const std::string& symbol);
+
+    // Find a seed (growing the table if needed) giving every symbol its own slot
+    void rehash();
+
+    std::vector<OperatorDescriptor> descriptors;
+    std::vector<int16_t> primary;                   // Operator id -> index of its primary descriptor
+    std::vector<int16_t> slots;                     // Hash slot -> descriptor index, -1 if empty
+    uint32_t seed;
+    size_t maxSymbolLength;
+    bool userOperators;
+};
+
+#endif // OPERATOR_REGISTRY_HPP
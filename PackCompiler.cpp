@@ -0,0 +1,43 @@
+#include "ExpressionCompiler.hpp"
+#include <iostream>
+#include <fstream>
+#include <string>
+
+/**
+ * Build-time tool: compile a formula list into C++
+ * Usage: pack_compiler <formulas.txt> <output.cpp> [namespace]
+ * Writes output.cpp and a matching output.hpp declaring the lookup table.
+ * Input lines have the form "name: expression".
+ */
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        std::cerr << "Usage: " << argv[0] << " <formulas.txt> <output.cpp> [namespace]" << std::endl;
+        return 1;
+    }
+    std::string sourcePath = argv[2];
+    std::string headerPath = sourcePath.substr(0, sourcePath.rfind('.')) + ".hpp";
+    std::string headerName = headerPath.substr(headerPath.find_last_of("/\\") + 1);
+    
+    try {
+        std::ifstream input(argv[1]);
+        if (!input) {
+            std::cerr << "Error: cannot open " << argv[1] << std::endl;
+            return 1;
+        }
+        ExpressionCompiler compiler(argc > 3 ? argv[3] : "expression_pack");
+        compiler.addFormulas(input);
+        
+        std::ofstream header(headerPath);
+        std::ofstream source(sourcePath);
+        compiler.generateHeader(header);
+        compiler.generateSource(source, headerName);
+        if (!header || !source) {
+            std::cerr << "Error: cannot write " << sourcePath << std::endl;
+            return 1;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
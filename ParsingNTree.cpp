@@ -2,9 +2,9 @@
 #include <stack>
 #include <vector>
 #include <sstream>
-#include <unordered_map>
 #include <cctype>
 #include <memory>
+#include "OperatorRegistry.hpp"
 
 using namespace std;
 
@@ -18,40 +18,25 @@ struct ExprNode {
 };
 
 // ------------------ Shunting Yard (Infix to Postfix) ------------------
+// Operator table of the demo: the evaluator's built-in operators, or
+// NOT / AND / OR for boolean expressions
+OperatorRegistry makeOperators(bool isBoolean) {
+    if (!isBoolean) {
+        return OperatorRegistry();
+    }
+    OperatorRegistry operators(false);
+    operators.addUnary("NOT", [](double a) { return (a == 0) ? 1.0 : 0.0; });
+    operators.addBinary("AND", 2, false, [](double a, double b) { return (a != 0 && b != 0) ? 1.0 : 0.0; });
+    operators.addBinary("OR", 1, false, [](double a, double b) { return (a != 0 || b != 0) ? 1.0 : 0.0; });
+    return operators;
+}
+
 class ShuntingYard {
 private:
-    unordered_map<string, int> precedence;
-    unordered_map<string, bool> rightAssociative;
-
-    void initializeOperators(bool isBoolean) {
-        if (isBoolean) {
-            precedence = {
-                {"NOT", 3},
-                {"AND", 2},
-                {"OR", 1}
-            };
-            rightAssociative = {
-                {"NOT", true},
-                {"AND", false},
-                {"OR", false}
-            };
-        }
-        else {
-            precedence = {
-                {"^", 3},
-                {"*", 2}, {"/", 2}, {"%", 2},
-                {"+", 1}, {"-", 1}
-            };
-            rightAssociative = {
-                {"^", true},
-                {"*", false}, {"/", false}, {"%", false},
-                {"+", false}, {"-", false}
-            };
-        }
-    }
+    const OperatorRegistry& operators;
 
     bool isOperator(const string& token) {
-        return precedence.find(token) != precedence.end();
+        return operators.find(token) != nullptr;
     }
 
     vector<string> tokenize(const string& expr) {
@@ -65,9 +50,7 @@ private:
     }
 
 public:
-    ShuntingYard(bool isBoolean = false) {
-        initializeOperators(isBoolean);
-    }
+    ShuntingYard(const OperatorRegistry& operators) : operators(operators) {}
 
     vector<string> convertToPostfix(const string& infix) {
         vector<string> output;
@@ -90,12 +73,12 @@ public:
                     operators.pop();
                 }
             }
-            else if (isOperator(token)) {
+            else if (const OperatorDescriptor* op = this->operators.find(token)) {
                 while (!operators.empty() && isOperator(operators.top())) {
-                    string top = operators.top();
-                    if ((rightAssociative[token] == false && precedence[token] <= precedence[top]) ||
-                        (rightAssociative[token] == true && precedence[token] < precedence[top])) {
-                        output.push_back(top);
+                    const OperatorDescriptor* top = this->operators.find(operators.top());
+                    if ((op->rightAssociative == false && op->precedence <= top->precedence) ||
+                        (op->rightAssociative == true && op->precedence < top->precedence)) {
+                        output.push_back(operators.top());
                         operators.pop();
                     }
                     else {
@@ -117,23 +100,15 @@ public:
 
 // ------------------ Expression Tree Builder ------------------
 
-bool isOperator(const string& token) {
-    return token == "+" || token == "-" || token == "*" || token == "/" || token == "%" ||
-        token == "^" || token == "AND" || token == "OR" || token == "NOT";
-}
-
-bool isUnary(const string& token) {
-    return token == "NOT";
-}
-
-ExprNode* buildExpressionTree(const vector<string>& postfix) {
+ExprNode* buildExpressionTree(const vector<string>& postfix, const OperatorRegistry& operators) {
     stack<ExprNode*> st;
 
     for (const string& token : postfix) {
-        if (!isOperator(token)) {
+        const OperatorDescriptor* op = operators.find(token);
+        if (!op) {
             st.push(new ExprNode(token));
         }
-        else if (isUnary(token)) {
+        else if (op->isUnary()) {
             ExprNode* node = new ExprNode(token);
             node->right = st.top(); st.pop();
             st.push(node);
@@ -150,14 +125,14 @@ ExprNode* buildExpressionTree(const vector<string>& postfix) {
 }
 
 // ----------------- inorder traversal for Testing
-void printInOrder(ExprNode* node) {
+void printInOrder(ExprNode* node, const OperatorRegistry& operators) {
     if (!node) return;
-    bool isOp = isOperator(node->value);
+    bool isOp = operators.find(node->value) != nullptr;
 
     if (isOp && node->left) cout << "(";
-    printInOrder(node->left);
+    printInOrder(node->left, operators);
     cout << " " << node->value << " ";
-    printInOrder(node->right);
+    printInOrder(node->right, operators);
     if (isOp && node->right) cout << ")";
 }
 
@@ -170,7 +145,8 @@ int main() {
     char isBool;
     cin >> isBool;
 
-    ShuntingYard parser(isBool == 'y');
+    OperatorRegistry operators = makeOperators(isBool == 'y');
+    ShuntingYard parser(operators);
     vector<string> postfix = parser.convertToPostfix(expr);
 
     cout << "Postfix: ";
@@ -179,10 +155,10 @@ int main() {
     }
     cout << endl;
 
-    ExprNode* root = buildExpressionTree(postfix);
+    ExprNode* root = buildExpressionTree(postfix, operators);
 
     cout << "Infix (from tree): ";
-    printInOrder(root);
+    printInOrder(root, operators);
     cout << endl;
 
     return 0;
@@ -0,0 +1,132 @@
+#ifndef RING_BUFFER_HPP
+#define RING_BUFFER_HPP
+
+#include <atomic>
+#include <vector>
+#include <cstddef>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <utility>
+
+/**
+ * Bounded lock-free multi-producer / multi-consumer ring buffer
+ * (sequence-numbered cells, after Dmitry Vyukov's bounded MPMC queue).
+ * With a single producer and a single consumer it behaves as an SPSC queue
+ * whose compare-and-swap operations never contend.
+ *
+ * push() blocks while the buffer is full, which gives backpressure to the
+ * producing stage; pop() blocks while it is empty until close() is called.
+ * Waiting spins, then yields, then sleeps for at most about a millisecond.
+ */
+template <typename T>
+class RingBuffer {
+public:
+    // Capacity is rounded up to a power of two
+    explicit RingBuffer(size_t capacity) : cells(roundUpToPowerOfTwo(capacity)), mask(cells.size() - 1),
+                                           enqueuePos(0), dequeuePos(0), closed(false) {
+        for (size_t i = 0; i < cells.size(); ++i) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    RingBuffer(const RingBuffer&) = delete;
+    RingBuffer& operator=(const RingBuffer&) = delete;
+
+    // Try to append an item; returns false if the buffer is full
+    bool tryPush(T& item) {
+        Cell* cell;
+        size_t pos = enqueuePos.load(std::memory_order_relaxed);
+        while (true) {
+            cell = &cells[pos & mask];
+            size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            long diff = static_cast<long>(sequence) - static_cast<long>(pos);
+            if (diff == 0) {
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+        cell->data = std::move(item);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Try to remove the oldest item; returns false if the buffer is empty
+    bool tryPop(T& item) {
+        Cell* cell;
+        size_t pos = dequeuePos.load(std::memory_order_relaxed);
+        while (true) {
+            cell = &cells[pos & mask];
+            size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            long diff = static_cast<long>(sequence) - static_cast<long>(pos + 1);
+            if (diff == 0) {
+                if (dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = dequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+        item = std::move(cell->data);
+        cell->sequence.store(pos + mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Append an item, waiting while the buffer is full
+    void push(T item) {
+        for (unsigned spins = 0; !tryPush(item); ++spins) {
+            backoff(spins);
+        }
+    }
+
+    // Remove the oldest item, waiting while the buffer is empty.
+    // Returns false once the buffer is closed and drained.
+    bool pop(T& item) {
+        for (unsigned spins = 0; !tryPop(item); ++spins) {
+            if (closed.load(std::memory_order_acquire)) {
+                return tryPop(item); // Items pushed before close() are visible now
+            }
+            backoff(spins);
+        }
+        return true;
+    }
+
+    // Signal that no more items will be pushed
+    void close() { closed.store(true, std::memory_order_release); }
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T data;
+    };
+
+    static size_t roundUpToPowerOfTwo(size_t n) {
+        size_t size = 2;
+        while (size < n) size <<= 1;
+        return size;
+    }
+
+    // Spin briefly, then give the core away to the other stages, then sleep
+    // for 1 us doubling up to about 1 ms, so an idle stage wakes at most about
+    // a thousand times a second instead of keeping a core busy
+    static void backoff(unsigned spins) {
+        if (spins < 64) return;
+        if (spins < 128) {
+            std::this_thread::yield();
+            return;
+        }
+        unsigned shift = std::min(spins - 128, 10u);
+        std::this_thread::sleep_for(std::chrono::microseconds(1u << shift));
+    }
+
+    std::vector<Cell> cells;
+    const size_t mask;
+    alignas(64) std::atomic<size_t> enqueuePos;
+    alignas(64) std::atomic<size_t> dequeuePos;
+    alignas(64) std::atomic<bool> closed;
+};
+
+#endif // RING_BUFFER_HPP
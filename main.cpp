@@ -1,13 +1,251 @@
 #include "ExpressionEvaluator.hpp"
+#include "ExpressionServer.hpp"
+#include "ExpressionPipeline.hpp"
+#include "ColumnStore.hpp"
+#include "ExpressionProfile.hpp"
+#include "CompiledExpression.hpp"
 #include <iostream>
 #include <iomanip>
 #include <string>
+#include <csignal>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+
+// Server instance stopped by SIGINT / SIGTERM
+static ExpressionServer* activeServer = nullptr;
+
+static void stopServer(int) {
+    if (activeServer) activeServer->stop();
+}
+
+/**
+ * Server mode: evaluate requests from a Unix domain socket until interrupted
+ */
+static int runServer(const std::string& socketPath) {
+    try {
+        ExpressionServer server(socketPath);
+        activeServer = &server;
+        std::signal(SIGINT, stopServer);
+        std::signal(SIGTERM, stopServer);
+        
+        std::cout << "Serving expressions on " << socketPath << std::endl;
+        server.run();
+        activeServer = nullptr;
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// Parse a whole decimal count in [1, limit]; false for anything else
+static bool parseCount(const std::string& text, size_t limit, size_t& value) {
+    if (text.empty() || !std::isdigit(static_cast<unsigned char>(text[0]))) return false;
+    char* end = nullptr;
+    errno = 0;
+    unsigned long long parsed = std::strtoull(text.c_str(), &end, 10);
+    if (*end != '\0' || errno == ERANGE || parsed == 0 || parsed > limit) return false;
+    value = static_cast<size_t>(parsed);
+    return true;
+}
+
+/**
+ * Batch mode: evaluate every line of stdin through the staged pipeline,
+ * one result line per input line, with stage utilization on stderr
+ */
+static int runPipeline(int argc, char* argv[]) {
+    const char* usage = "Usage: --pipeline [--parsers N] [--evaluators N] [--batch-size N] [--queue-capacity N]";
+    const size_t MAX_THREADS = 1024;
+    const size_t MAX_SIZE = 1 << 20;
+    
+    ExpressionPipeline::Options options;
+    for (int i = 2; i < argc; i += 2) {
+        std::string flag = argv[i];
+        size_t* target = nullptr;
+        size_t limit = MAX_SIZE;
+        if (flag == "--parsers") {
+            target = &options.parserThreads;
+            limit = MAX_THREADS;
+        } else if (flag == "--evaluators") {
+            target = &options.evaluatorThreads;
+            limit = MAX_THREADS;
+        } else if (flag == "--batch-size") {
+            target = &options.batchSize;
+        } else if (flag == "--queue-capacity") {
+            target = &options.queueCapacity;
+        }
+        if (!target) {
+            std::cerr << "Error: unknown option " << flag << "\n" << usage << std::endl;
+            return 1;
+        }
+        if (i + 1 >= argc || !parseCount(argv[i + 1], limit, *target)) {
+            std::cerr << "Error: " << flag << " needs a whole number from 1 to " << limit << "\n" << usage
+                      << std::endl;
+            return 1;
+        }
+    }
+    
+    try {
+        std::ios::sync_with_stdio(false);
+        ExpressionPipeline pipeline(options);
+        pipeline.run(std::cin, std::cout);
+        pipeline.printMetrics(std::cerr);
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Columnar mode: evaluate one expression over every row of memory-mapped
+ * column files and/or a CSV file. Results go to a raw float64 column file
+ * with --output, otherwise one line per row to stdout.
+ */
+static int runColumns(int argc, char* argv[]) {
+    const char* usage = "Usage: --columns <expression> [--float64 name=path] [--int64 name=path] [--csv path]"
+                        " [--threads N] [--output path]";
+    const size_t MAX_THREADS = 1024;
+    if (argc < 3) {
+        std::cerr << "Error: --columns needs an expression\n" << usage << std::endl;
+        return 1;
+    }
+    
+    try {
+        std::string outputPath;
+        size_t threads = 0;
+        for (int i = 3; i < argc; i += 2) {
+            std::string flag = argv[i];
+            if (i + 1 >= argc) {
+                std::cerr << "Error: " << flag << " needs a value\n" << usage << std::endl;
+                return 1;
+            }
+            if (flag == "--output") {
+                outputPath = argv[i + 1];
+            } else if (flag == "--threads" && !parseCount(argv[i + 1], MAX_THREADS, threads)) {
+                std::cerr << "Error: --threads needs a whole number from 1 to " << MAX_THREADS << "\n" << usage
+                          << std::endl;
+                return 1;
+            }
+        }
+        
+        ColumnStore store;
+        for (int i = 3; i + 1 < argc; i += 2) {
+            std::string flag = argv[i];
+            std::string value = argv[i + 1];
+            if (flag == "--float64" || flag == "--int64") {
+                size_t equals = value.find('=');
+                if (equals == std::string::npos) {
+                    std::cerr << "Error: expected name=path after " << flag << std::endl;
+                    return 1;
+                }
+                store.mapColumn(value.substr(0, equals), value.substr(equals + 1),
+                                flag == "--int64" ? ColumnStore::INT64 : ColumnStore::FLOAT64);
+            } else if (flag == "--csv") {
+                store.loadCsv(value, threads);
+            } else if (flag != "--output" && flag != "--threads") {
+                std::cerr << "Error: unknown option " << flag << "\n" << usage << std::endl;
+                return 1;
+            }
+        }
+        
+        ExpressionEvaluator evaluator;
+        CompiledExpression expression(evaluator, argv[2]);
+        ExpressionEvaluator::BatchResult result = store.evaluate(expression, threads);
+        if (outputPath.empty()) {
+            std::ios::sync_with_stdio(false);
+            ColumnStore::writeText(result, std::cout, threads);
+        } else {
+            ColumnStore::writeBinary(result, outputPath);
+        }
+        std::cerr << store.getRowCount() << " rows, " << result.errorCount << " errors" << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Explain mode: evaluate an expression repeatedly with per-node profiling,
+ * then print the annotated tree and the JSON report
+ */
+static int runExplain(int argc, char* argv[]) {
+    if (argc < 3) {
+        std::cerr << "Error: --explain needs an expression" << std::endl;
+        return 1;
+    }
+    
+    const char* usage = "Usage: --explain <expression> [--iterations N] [--set name=value]...";
+    const size_t MAX_ITERATIONS = 1000000000;
+    
+    try {
+        ExpressionEvaluator evaluator;
+        size_t iterations = 1;
+        for (int i = 3; i < argc; i += 2) {
+            std::string flag = argv[i];
+            if (i + 1 >= argc) {
+                std::cerr << "Error: " << flag << " needs a value\n" << usage << std::endl;
+                return 1;
+            }
+            std::string value = argv[i + 1];
+            size_t equals = value.find('=');
+            if (flag == "--iterations") {
+                if (!parseCount(value, MAX_ITERATIONS, iterations)) {
+                    std::cerr << "Error: --iterations needs a whole number from 1 to " << MAX_ITERATIONS << "\n"
+                              << usage << std::endl;
+                    return 1;
+                }
+            } else if (flag == "--set" && equals != std::string::npos) {
+                evaluator.setVariable(value.substr(0, equals), std::stod(value.substr(equals + 1)));
+            } else {
+                std::cerr << "Error: unknown option " << flag << " " << value << std::endl;
+                return 1;
+            }
+        }
+        
+        ExpressionProfile profile(evaluator.buildExpressionTree(argv[2]));
+        ExpressionEvaluator::Value result{false, 0, 0};
+        ExpressionError::Code error = ExpressionError::NONE;
+        for (size_t i = 0; i < iterations; ++i) {
+            error = evaluator.tryEvaluate(profile, result);
+        }
+        
+        std::cout << "Result: " << (error == ExpressionError::NONE ? ExpressionEvaluator::formatResult(result)
+                                                                   : ExpressionError::message(error)) << std::endl;
+        profile.display(std::cout);
+        std::cout << profile.toJson();
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
 
 /**
  * Main application entry point
  * Handles user input, expression evaluation, and output
+ * Usage: calculator [--serve [socket-path]]
+ *        calculator --pipeline [--parsers N] [--evaluators N] [--batch-size N] [--queue-capacity N] < input
+ *        calculator --columns <expression> [--float64 name=path] [--int64 name=path] [--csv path]
+ *                   [--threads N] [--output path]
+ *        calculator --explain <expression> [--iterations N] [--set name=value]...
  */
-int main() {
+int main(int argc, char* argv[]) {
+    if (argc > 1 && std::string(argv[1]) == "--serve") {
+        return runServer(argc > 2 ? argv[2] : "/tmp/expression-evaluator.sock");
+    }
+    if (argc > 1 && std::string(argv[1]) == "--pipeline") {
+        return runPipeline(argc, argv);
+    }
+    if (argc > 1 && std::string(argv[1]) == "--columns") {
+        return runColumns(argc, argv);
+    }
+    if (argc > 1 && std::string(argv[1]) == "--explain") {
+        return runExplain(argc, argv);
+    }
+    
     ExpressionEvaluator evaluator;
     std::string expression;
     
@@ -31,24 +269,25 @@ int main() {
         }
         
         try {
-            // Build expression tree
-            ExpressionTree tree = evaluator.buildExpressionTree(expression);
+            // Build expression tree (very long inputs are parsed in parallel)
+            ExpressionTree tree = evaluator.buildExpressionTreeParallel(expression);
             
             // Option to display tree structure (for debugging)
             // tree.displayTree();
             
-            // Evaluate expression and display result
-            double result = evaluator.evaluate(tree);
+            // Evaluate expression and display result (integers stay exact).
+            // The compiled form evaluates without recursion: a long generated
+            // sum parses to a chain as deep as it has terms.
+            CompiledExpression compiled(evaluator, tree);
+            const double* noVariables = nullptr;
+            ExpressionEvaluator::Value result;
+            ExpressionError::Code error = compiled.evaluate(noVariables, result);
+            if (error != ExpressionError::NONE) {
+                throw ExpressionError(error);
+            }
             
             // Show result with high precision for floating point values
-            std::cout << "Result: ";
-            
-            // Check if result is effectively an integer
-            if (std::abs(result - std::round(result)) < 1e-10) {
-                std::cout << static_cast<long long>(result) << std::endl;
-            } else {
-                std::cout << std::fixed << std::setprecision(6) << result << std::endl;
-            }
+            std::cout << "Result: " << ExpressionEvaluator::formatResult(result) << std::endl;
             
             // Optional: Display the expression in different traversal forms
             // std::cout << "Inorder: " << tree.inOrderTraversal() << std::endl;